@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "Attachment.h"
+
+#include <limits>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		constexpr size_t metadataSizeSize = 4;
+		constexpr size_t countSize = 4;
+		constexpr size_t attachmentSizeSize = 8;
+		constexpr size_t paddingSizeSize = 1;
+		constexpr size_t attachmentAlignment = 16;
+
+		size_t paddingAt(size_t offset)
+		{
+			return (attachmentAlignment - offset % attachmentAlignment) % attachmentAlignment;
+		}
+
+		void appendLittleEndian(std::string& out, uint64_t value, size_t size)
+		{
+			for (size_t i = 0; i < size; ++i)
+			{
+				out.push_back(static_cast<char>(value >> (8 * i)));
+			}
+		}
+
+		uint64_t readLittleEndian(std::span<const std::byte> bytes, size_t size)
+		{
+			uint64_t value = 0;
+			for (size_t i = 0; i < size; ++i)
+			{
+				value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+			}
+
+			return value;
+		}
+	}
+
+	void appendAttachments(std::string& out, size_t bodyOffset, std::span<const std::span<const std::byte>> attachments)
+	{
+		if (attachments.size() > std::numeric_limits<uint32_t>::max())
+		{
+			throw std::invalid_argument{ "Too many attachments" };
+		}
+
+		size_t totalSize = countSize + attachments.size() * attachmentSizeSize + paddingSizeSize + attachmentAlignment - 1;
+		for (const std::span<const std::byte>& attachment : attachments)
+		{
+			totalSize += attachmentAlignment - 1 + attachment.size();
+		}
+
+		// one allocation at most, the thread buffer usually has room already
+		out.reserve(out.size() + totalSize);
+
+		appendLittleEndian(out, attachments.size(), countSize);
+		for (const std::span<const std::byte>& attachment : attachments)
+		{
+			appendLittleEndian(out, attachment.size(), attachmentSizeSize);
+		}
+
+		// the receiver doesnt know where the message started, so the first padding is written down
+		size_t padding = paddingAt(bodyOffset + out.size() + paddingSizeSize);
+		out.push_back(static_cast<char>(padding));
+		out.append(padding, '\0');
+
+		size_t firstAttachment = out.size();
+
+		for (const std::span<const std::byte>& attachment : attachments)
+		{
+			out.append(paddingAt(out.size() - firstAttachment), '\0');
+			out.append(reinterpret_cast<const char*>(attachment.data()), attachment.size());
+		}
+	}
+
+	nlohmann::json readAttachments(std::span<const std::byte> data, std::vector<Attachment>& attachments)
+	{
+		if (data.size() < metadataSizeSize)
+		{
+			throw std::runtime_error{ "Message with attachments too short" };
+		}
+
+		size_t metadataSize = readLittleEndian(data, metadataSizeSize);
+		if (data.size() - metadataSizeSize < metadataSize + countSize)
+		{
+			throw std::runtime_error{ "Message with attachments too short" };
+		}
+
+		std::string_view metadataText{ reinterpret_cast<const char*>(data.data()) + metadataSizeSize, metadataSize };
+
+		size_t offset = metadataSizeSize + metadataSize;
+		size_t count = readLittleEndian(data.subspan(offset), countSize);
+		offset += countSize;
+
+		// checked against what is left before anything is reserved, so a broken count cant make us allocate gigabytes
+		if ((data.size() - offset) / attachmentSizeSize < count)
+		{
+			throw std::runtime_error{ "Message with attachments too short" };
+		}
+
+		size_t sizesOffset = offset;
+		offset += count * attachmentSizeSize;
+
+		if (data.size() - offset < paddingSizeSize)
+		{
+			throw std::runtime_error{ "Message with attachments too short" };
+		}
+
+		size_t padding = readLittleEndian(data.subspan(offset), paddingSizeSize);
+		offset += paddingSizeSize + padding;
+
+		if (padding >= attachmentAlignment || offset > data.size())
+		{
+			throw std::runtime_error{ "Message with attachments too short" };
+		}
+
+		size_t firstAttachment = offset;
+
+		attachments.clear();
+		attachments.reserve(count);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint64_t size = readLittleEndian(data.subspan(sizesOffset + i * attachmentSizeSize), attachmentSizeSize);
+
+			offset += paddingAt(offset - firstAttachment);
+			if (offset > data.size() || data.size() - offset < size)
+			{
+				throw std::runtime_error{ "Message with attachments too short" };
+			}
+
+			attachments.emplace_back(data.subspan(offset, size));
+			offset += size;
+		}
+
+		return metadataText.empty() ? nlohmann::json{} : nlohmann::json::parse(metadataText);
+	}
+}
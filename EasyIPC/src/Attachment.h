@@ -0,0 +1,117 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+namespace EasyIPC
+{
+	/*
+	One binary attachment of an event emitted with emitAttachments(), handed to onAttachments() handlers:
+
+	client.onAttachments("samples", [](const nlohmann::json& meta, std::span<const EasyIPC::Attachment> attachments)
+	{
+		std::span<const float> samples = attachments[0].as<float>();
+	});
+
+	Like the rest of the message it is only valid until the handler returns.
+	*/
+	class Attachment
+	{
+	public:
+		explicit Attachment(std::span<const std::byte> bytes) :
+			data{ bytes }
+		{
+
+		}
+
+		std::span<const std::byte> bytes() const { return data; }
+		size_t size() const { return data.size(); }
+
+		// The attachment as an array of numbers, e.g. float samples. Throws if the size isnt a multiple of sizeof(T).
+		// Normally this points straight into the message (see AttachedData), if the bytes arent aligned for T anyway
+		// they are copied once into memory of this attachment.
+		template<typename T>
+			requires std::is_arithmetic_v<T>
+		std::span<const T> as() const
+		{
+			if (data.size() % sizeof(T) != 0)
+			{
+				throw std::runtime_error{ "Attachment of " + std::to_string(data.size()) + " bytes isnt an array of " + std::to_string(sizeof(T)) + " byte values" };
+			}
+
+			const std::byte* bytes = data.data();
+
+			if (reinterpret_cast<uintptr_t>(bytes) % alignof(T) != 0)
+			{
+				if (!alignedCopy)
+				{
+					alignedCopy = std::make_unique<std::max_align_t[]>((data.size() + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+					std::memcpy(alignedCopy.get(), data.data(), data.size());
+				}
+
+				bytes = reinterpret_cast<const std::byte*>(alignedCopy.get());
+			}
+
+			return { reinterpret_cast<const T*>(bytes), data.size() / sizeof(T) };
+		}
+
+	private:
+		std::span<const std::byte> data;
+		mutable std::unique_ptr<std::max_align_t[]> alignedCopy;
+	};
+
+	/*
+	An event with attachments is sent as raw data:
+
+	metadata size (4, little endian) | metadata as json (empty for null) | attachment count (4) | size of each attachment (8 each)
+	| padding size (1) | padding | attachments
+
+	The padding puts the first attachment at a multiple of 16 bytes from the start of the nng message body, the others follow
+	at multiples of 16 from the first one. nng allocates message bodies aligned, so the typed views of Attachment::as()
+	normally point straight into the message.
+	*/
+	struct AttachedData
+	{
+		// explicit, so a braced json like { {"key", value} } never ends up here
+		explicit AttachedData(const nlohmann::json& metadata, std::span<const std::span<const std::byte>> attachments, size_t bodyOffset) :
+			metadata{ metadata },
+			attachments{ attachments },
+			bodyOffset{ bodyOffset }
+		{
+
+		}
+
+		const nlohmann::json& metadata;
+		std::span<const std::span<const std::byte>> attachments;
+
+		// Where the envelope will start in the body of the message, see plainTextOffset()
+		size_t bodyOffset;
+	};
+
+	// Appends everything behind the metadata json, out starts bodyOffset bytes into the body of the message
+	void appendAttachments(std::string& out, size_t bodyOffset, std::span<const std::span<const std::byte>> attachments);
+
+	// Returns the metadata and fills attachments with views into data, throws if data isnt an event with attachments
+	nlohmann::json readAttachments(std::span<const std::byte> data, std::vector<Attachment>& attachments);
+
+	// Wraps a handler of metadata and attachments into one of the raw data, for the onAttachments() of server and clients.
+	// Whatever the handler returns, e.g. the response of a server handler, is returned as it is.
+	template<typename Handler>
+	auto readingAttachments(Handler handler)
+	{
+		return [handler = std::move(handler)](std::span<const std::byte> bytes)
+		{
+			std::vector<Attachment> attachments;
+			nlohmann::json metadata = readAttachments(bytes, attachments);
+			return handler(metadata, std::span<const Attachment>{ attachments });
+		};
+	}
+}
@@ -1,24 +1,63 @@
 #include "pch.h"
 #include "Client.h"
 
+#include <chrono>
 #include <iostream>
+#include <algorithm>
+#include <random>
 #include <utility>
 
 #include <nng/nng.h>
 #include <nng/protocol/pubsub0/sub.h>
 #include <nng/protocol/reqrep0/req.h>
+#include <nng/protocol/pair1/pair.h>
 
 #include "NngSocket.h"
+#include "NngMessage.h"
+#include "Framing.h"
+#include "Envelope.h"
+#include "PortLayout.h"
+#include "Encryption/SessionEncryptionStrategy.h"
 
 namespace EasyIPC
 {
+	namespace
+	{
+		// How often the direct receive loop wakes up to check whether it has to (re)introduce itself to the server
+		constexpr int directReceiveTimeoutMS = 250;
+
+		std::string generateClientId()
+		{
+			std::random_device device;
+			std::mt19937_64 generator{ (static_cast<uint64_t>(device()) << 32) | device() };
+
+			std::ostringstream oss;
+			oss << "client-" << std::hex << generator();
+			return oss.str();
+		}
+
+		// nng calls this whenever the direct socket got a new connection to the server, including reconnects.
+		// We are not allowed to use the socket from in here, so only flag that the server needs to learn who we are.
+		void onDirectPipeAdded(nng_pipe, nng_pipe_ev, void* helloPending)
+		{
+			static_cast<std::atomic<bool>*>(helloPending)->store(true);
+		}
+	}
+
 	Client::Client() :
-		subSocket{ std::make_unique<NngSocket>() },
-		reqSocket{ std::make_unique<NngSocket>() },
+		directSocket{ std::make_unique<NngSocket>() },
 		isRunning{ false },
-		connected{ false }
+		connected{ false },
+		helloPending{ false },
+		handshakePending{ false },
+		clientId{ generateClientId() },
+		requestTimeoutMS{ -1 }
 	{
-
+		for (Lane& lane : lanes)
+		{
+			lane.subSocket = std::make_unique<NngSocket>();
+			lane.reqSocket = std::make_unique<NngSocket>();
+		}
 	}
 
 	Client::~Client()
@@ -26,56 +65,106 @@ namespace EasyIPC
 		shutdown();
 	}
 
-	void Client::connect(const std::string& url, uint16_t port, int maxRetries, int retryDelayMS)
+	void Client::connect(const std::string& url, uint16_t port, int maxRetries, int retryDelayMS, const ConnectionConfig& config)
 	{
 		int returnValue{};
 
-		// first open pub/sub socket so we can receive events
-		if ((returnValue = nng_sub0_open(&subSocket->get())) != 0)
+		for (Lane& lane : lanes)
+		{
+			// first open pub/sub socket so we can receive events
+			if ((returnValue = nng_sub0_open(&lane.subSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open SUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.subSocket->markOpen();
+			lane.subSocket->applyConfig(config);
+
+			if (config.overflowPolicy == OverflowPolicy::DropOldest
+				&& (returnValue = nng_socket_set_bool(lane.subSocket->get(), NNG_OPT_SUB_PREFNEW, true)) != 0)
+			{
+				throw std::runtime_error{ "Failed to set overflow policy: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			// then open req socket for typical request/response type interactions
+			if ((returnValue = nng_req0_open(&lane.reqSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open REQ socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.reqSocket->markOpen();
+			lane.reqSocket->applyConfig(config);
+		}
+
+		applyRequestTimeout();
+
+		// and finally the pair socket the server uses to emit events to only this client
+		if ((returnValue = nng_pair1_open(&directSocket->get())) != 0)
 		{
-			throw std::runtime_error{ "Failed to open SUB socket: " + std::string(nng_strerror(returnValue)) };
+			throw std::runtime_error{ "Failed to open PAIR socket: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		subSocket->markOpen();
+		directSocket->markOpen();
+		directSocket->applyConfig(config);
 
-		// then open req socket for typical request/response type interactions
-		if ((returnValue = nng_req0_open(&reqSocket->get())) != 0)
+		if ((returnValue = nng_pipe_notify(directSocket->get(), NNG_PIPE_EV_ADD_POST, onDirectPipeAdded, &helloPending)) != 0)
 		{
-			throw std::runtime_error{ "Failed to open REQ socket: " + std::string(nng_strerror(returnValue)) };
+			throw std::runtime_error{ "Failed to set PAIR pipe notification: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		reqSocket->markOpen();
+		if ((returnValue = nng_socket_set_ms(directSocket->get(), NNG_OPT_RECVTIMEO, directReceiveTimeoutMS)) != 0)
+		{
+			throw std::runtime_error{ "Failed to set PAIR receive timeout: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		struct Dial
+		{
+			NngSocket& socket;
+			std::string url;
+			std::string& lastError;
+			const char* label;
+			bool dialed;
+		};
 
-		std::string subSocketUrl = url + ":" + std::to_string(port);
-		std::string reqSocketUrl = url + ":" + std::to_string(port + 1);
+		std::vector<Dial> dials;
 
-		// connect to server
+		for (size_t lane = 0; lane < priorityCount; ++lane)
+		{
+			Priority priority = static_cast<Priority>(lane);
+			dials.push_back({ *lanes[lane].subSocket, makeSocketUrl(url, port, PortOffset::publish(priority)), lastSubDialError, "SUB", false });
+			dials.push_back({ *lanes[lane].reqSocket, makeSocketUrl(url, port, PortOffset::request(priority)), lastReqDialError, "REQ", false });
+		}
+
+		dials.push_back({ *directSocket, makeSocketUrl(url, port, PortOffset::Direct), lastDirectDialError, "PAIR", false });
+
+		// connect to server, sockets that connected in an earlier attempt arent dialed again
 		int attempts{ 0 };
 		bool connectSuccess{ false };
 
 		while (attempts < maxRetries)
 		{
-			returnValue = nng_dial(subSocket->get(), subSocketUrl.c_str(), nullptr, 0);
-			if (returnValue == 0)
+			connectSuccess = true;
+
+			for (Dial& dial : dials)
 			{
-				returnValue = nng_dial(reqSocket->get(), reqSocketUrl.c_str(), nullptr, 0);
-				if (returnValue == 0)
+				if (dial.dialed)
+					continue;
+
+				returnValue = nng_dial(dial.socket.get(), dial.url.c_str(), nullptr, 0);
+				if (returnValue != 0)
 				{
-					connectSuccess = true;
+					dial.lastError = nng_strerror(returnValue);
+					std::cerr << "[Client::connect] Attempt" << (attempts + 1) << ": Failed to dial " << dial.label << " socket: " << dial.lastError << std::endl;
+					connectSuccess = false;
 					break;
 				}
-				else
-				{
-					lastReqDialError = nng_strerror(returnValue);
-					std::cerr << "[Client::connect] Attempt" << (attempts + 1) << ": Failed to dial REQ socket: " << lastReqDialError << std::endl;
-				}
-			}
-			else
-			{
-				lastSubDialError = nng_strerror(returnValue);
-				std::cerr << "[Client::connect] Attempt" << (attempts + 1) << ": Failed to dial SUB socket: " << lastSubDialError << std::endl;
+
+				dial.dialed = true;
 			}
 
+			if (connectSuccess)
+				break;
+
 			++attempts;
 			if (attempts < maxRetries)
 			{
@@ -90,19 +179,35 @@ namespace EasyIPC
 					std::ostringstream oss;
 					oss << "Failed to connect to server after " << maxRetries
 						<< " retries. Last sub socket dial error: " << lastSubDialError
-						<< ", Last req socket dial error: " << lastReqDialError;
+						<< ", Last req socket dial error: " << lastReqDialError
+						<< ", Last direct socket dial error: " << lastDirectDialError;
 					return oss.str();
 				}()
 			);
 		}
 
-		if ((returnValue = nng_setopt(subSocket->get(), NNG_OPT_SUB_SUBSCRIBE, "", 0)) != 0)
+		for (Lane& lane : lanes)
 		{
-			throw std::runtime_error{ "Failed to set subscribe option: " + std::string(nng_strerror(returnValue)) };
+			if ((returnValue = nng_setopt(lane.subSocket->get(), NNG_OPT_SUB_SUBSCRIBE, "", 0)) != 0)
+			{
+				throw std::runtime_error{ "Failed to set subscribe option: " + std::string(nng_strerror(returnValue)) };
+			}
+		}
+
+		// has to be done before anything is sent or received
+		if (usesSessions())
+		{
+			performHandshake();
 		}
 
 		isRunning = true;
-		receiveThread = std::thread(&Client::receiveLoop, this);
+
+		for (Lane& lane : lanes)
+		{
+			lane.receiveThread = std::thread(&Client::receiveLoop, this, std::ref(lane));
+		}
+
+		directReceiveThread = std::thread(&Client::directReceiveLoop, this);
 		connected = true;
 
 		std::cout << "[EasyIPC::Client::connect] Started...\n";
@@ -121,12 +226,25 @@ namespace EasyIPC
 		{
 			isRunning = false;
 
-			subSocket->close();
-			reqSocket->close();
+			for (Lane& lane : lanes)
+			{
+				lane.subSocket->close();
+				lane.reqSocket->close();
+			}
+
+			directSocket->close();
 
-			if (receiveThread.joinable())
+			for (Lane& lane : lanes)
 			{
-				receiveThread.join();
+				if (lane.receiveThread.joinable())
+				{
+					lane.receiveThread.join();
+				}
+			}
+
+			if (directReceiveThread.joinable())
+			{
+				directReceiveThread.join();
 			}
 
 			connected = false;
@@ -134,56 +252,304 @@ namespace EasyIPC
 
 	}
 
-	void Client::on(const std::string& event, std::function<void(const nlohmann::json&)> handler)
+	void Client::setClientId(const std::string& id)
+	{
+		if (connected)
+		{
+			throw std::runtime_error{ "[EasyIPC::Client::setClientId] The client id can only be changed before connecting." };
+		}
+
+		clientId = id;
+	}
+
+	void Client::setRequestTimeout(int timeoutMS)
+	{
+		requestTimeoutMS = timeoutMS;
+
+		if (connected)
+		{
+			applyRequestTimeout();
+		}
+	}
+
+	void Client::applyRequestTimeout()
+	{
+		int returnValue{};
+
+		for (Lane& lane : lanes)
+		{
+			if ((returnValue = nng_socket_set_ms(lane.reqSocket->get(), NNG_OPT_SENDTIMEO, requestTimeoutMS)) != 0
+				|| (returnValue = nng_socket_set_ms(lane.reqSocket->get(), NNG_OPT_RECVTIMEO, requestTimeoutMS)) != 0)
+			{
+				throw std::runtime_error{ "Failed to set request timeout: " + std::string(nng_strerror(returnValue)) };
+			}
+		}
+	}
+
+	void Client::on(const std::string& event, std::function<void(const nlohmann::json&)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventHandlers[event] = { handler, nullptr, nullptr, nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	void Client::onView(const std::string& event, std::function<void(const DataView&)> handler, std::optional<Priority> priority)
 	{
 		std::lock_guard<std::mutex> lock(handlerMutex);
-		eventHandlers[event] = handler;
+		eventHandlers[event] = { nullptr, handler, nullptr, nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	void Client::onArena(const std::string& event, std::function<void(const ArenaJson&)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventHandlers[event] = { nullptr, nullptr, handler, nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	void Client::onRaw(const std::string& event, std::function<void(std::span<const std::byte>)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventHandlers[event] = { nullptr, nullptr, nullptr, handler };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	void Client::setEventPriority(const std::string& event, Priority priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventPriorities[event] = priority;
+	}
+
+	Priority Client::getEventPriority(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		auto priority = eventPriorities.find(event);
+		return priority != eventPriorities.end() ? priority->second : Priority::Normal;
+	}
+
+	void Client::setEventProtection(const std::string& event, Protection protection)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventProtections[event] = protection;
+	}
+
+	Protection Client::getEventProtection(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		auto protection = eventProtections.find(event);
+		return protection != eventProtections.end() ? protection->second : Protection::Encrypt;
+	}
+
+	void Client::checkProtection(const std::string& event, Protection protection)
+	{
+		// without a strategy nothing is protected anyway
+		if (!encryptionStrategy || isProtectedEnough(protection, getEventProtection(event)))
+			return;
+
+		// someone is sending us a weaker message than we agreed on, e.g. plaintext where it should be encrypted
+		encryptionStrategy->reportCompromised();
+		throw std::runtime_error{ "Event " + event + " arrived with weaker protection than expected" };
 	}
 
 	nlohmann::json Client::emit(const std::string& event, const nlohmann::json& data)
+	{
+		return emitData(event, data);
+	}
+
+	nlohmann::json Client::emitRaw(const std::string& event, std::span<const std::byte> data)
+	{
+		return emitData(event, data);
+	}
+
+	nlohmann::json Client::emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments)
+	{
+		return emitData(event, AttachedData{ metadata, attachments, plainTextOffset(getDirectStrategy().get(), getEventProtection(event)) });
+	}
+
+	template<typename Data>
+	nlohmann::json Client::emitData(const std::string& event, const Data& data)
 	{
 		if (!connected)
 		{
 			throw std::runtime_error{ "Client is not connected. Cant emit." };
 		}
 
-		std::lock_guard<std::mutex> lock(reqMutex);
+		// each priority has its own REQ socket, so an urgent emit doesnt wait for the response to a large one
+		Lane& lane = lanes[static_cast<size_t>(getEventPriority(event))];
+		std::lock_guard<std::mutex> lock(lane.reqMutex);
 
-		nlohmann::json messageJson = {
-			{"event", event},
-			{"data", data}
-		};
+		std::shared_ptr<EncryptionStrategy> strategy = getDirectStrategy();
+		NngMessage message = sealEvent(strategy.get(), getEventProtection(event), writeEnvelopeToThreadBuffer(event, data));
 
-		std::string message = messageJson.dump(0);
+		int returnValue = message.send(lane.reqSocket->get());
+		if (returnValue != 0)
+		{
+			dropStatistics.countSend(event);
+			throw TransportError{ "Failed to send request: " + std::string(nng_strerror(returnValue)) };
+		}
 
-		if (encryptionStrategy)
+		NngMessage response;
+		returnValue = response.receive(lane.reqSocket->get());
+		if (returnValue != 0)
 		{
-			message = encryptionStrategy->encrypt(message);
+			// the server might have handled it, but as far as we know it got lost
+			dropStatistics.countSend(event);
+			throw TransportError{ "Failed to receive response: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		int returnValue = nng_send(reqSocket->get(), message.data(), message.size(), 0);
+		if (usesSessions() && SessionEncryptionStrategy::isUnknownSession(response.body()))
+		{
+			// the server didnt handle it, so emitting it again is safe once we have a new session
+			handshakePending = true;
+			dropStatistics.countSend(event);
+			throw std::runtime_error{ "The server doesnt know our session (anymore), a new handshake was started. Emit again." };
+		}
+
+		std::string fallback;
+		OpenedEvent opened = openEvent(strategy.get(), response, fallback);
+
+		// the response has to be protected like the request
+		checkProtection(event, opened.protection);
+
+		return readResponse(opened.plainText);
+	}
+
+	std::vector<nlohmann::json> Client::emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events)
+	{
+		if (!connected)
+		{
+			throw std::runtime_error{ "Client is not connected. Cant emit." };
+		}
+
+		if (events.empty())
+			return {};
+
+		// one request can only go out once, so it takes the most urgent lane and the strongest protection of its events
+		Priority priority = Priority::Normal;
+		Protection protection = Protection::Plaintext;
+		std::vector<std::string> records;
+		records.reserve(events.size());
+
+		for (const auto& [event, data] : events)
+		{
+			if (getEventPriority(event) == Priority::Control)
+			{
+				priority = Priority::Control;
+			}
+
+			protection = strongerProtection(protection, getEventProtection(event));
+
+			records.push_back(writeEnvelope(event, data));
+		}
+
+		Lane& lane = lanes[static_cast<size_t>(priority)];
+		std::lock_guard<std::mutex> lock(lane.reqMutex);
+
+		std::shared_ptr<EncryptionStrategy> strategy = getDirectStrategy();
+		NngMessage message = sealBatch(strategy.get(), protection, records);
+
+		auto countAll = [this, &events]
+		{
+			for (const auto& [event, data] : events)
+			{
+				dropStatistics.countSend(event);
+			}
+		};
+
+		int returnValue = message.send(lane.reqSocket->get());
 		if (returnValue != 0)
 		{
-			throw std::runtime_error{ "Failed to send request: " + std::string(nng_strerror(returnValue)) };
+			countAll();
+			throw TransportError{ "Failed to send request: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		char* buffer = nullptr;
-		size_t size = 0;
-		returnValue = nng_recv(reqSocket->get(), &buffer, &size, NNG_FLAG_ALLOC);
+		NngMessage response;
+		returnValue = response.receive(lane.reqSocket->get());
 		if (returnValue != 0)
 		{
-			throw std::runtime_error{ "Failed to receive response: " + std::string(nng_strerror(returnValue)) };
+			countAll();
+			throw TransportError{ "Failed to receive response: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		std::string response(buffer, size);
-		nng_free(buffer, size);
+		if (usesSessions() && SessionEncryptionStrategy::isUnknownSession(response.body()))
+		{
+			handshakePending = true;
+			countAll();
+			throw std::runtime_error{ "The server doesnt know our session (anymore), a new handshake was started. Emit again." };
+		}
 
-		if (encryptionStrategy)
+		std::string fallback;
+		OpenedEvent opened = openEvent(strategy.get(), response, fallback);
+
+		// the server only answers with a single message if it couldnt open the batch at all
+		if (!opened.isBatch)
+		{
+			throw std::runtime_error{ "The server rejected the batch: " + std::string(opened.plainText) };
+		}
+
+		std::vector<std::string_view> responseRecords = splitBatch(opened.plainText);
+		if (responseRecords.size() != events.size())
 		{
-			response = encryptionStrategy->decrypt(response);
+			throw std::runtime_error{ "Expected " + std::to_string(events.size()) + " responses, got " + std::to_string(responseRecords.size()) };
 		}
 
-		return nlohmann::json::parse(response);
+		std::vector<nlohmann::json> responses;
+		responses.reserve(events.size());
+
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			// every response has to be protected like its request
+			checkProtection(events[i].first, opened.protection);
+			responses.push_back(readResponse(responseRecords[i]));
+		}
+
+		return responses;
+	}
+
+	const nlohmann::json* Client::applyDelta(const std::string& event, const Envelope& envelope)
+	{
+		std::lock_guard<std::mutex> lock(deltaMutex);
+		DeltaValue& value = deltaValues[event];
+
+		// stays invalid if parsing or patching throws halfway through
+		uint64_t previousSequence = value.sequence;
+		bool wasValid = value.valid;
+		value.valid = false;
+
+		if (envelope.kind == EnvelopeKind::Keyframe)
+		{
+			value.value = envelope.parseData();
+		}
+		else
+		{
+			// a delta only applies to the value right before it, after a lost message we have to wait for the next keyframe
+			if (!wasValid || previousSequence + 1 != envelope.sequence)
+				return nullptr;
+
+			value.value.patch_inplace(envelope.parseData());
+		}
+
+		value.sequence = envelope.sequence;
+		value.valid = true;
+
+		// events of one priority are handled one after another, so nobody changes it while the handler looks at it
+		return &value.value;
+	}
+
+	std::unordered_map<std::string, DropCounters> Client::getDropCounters()
+	{
+		return dropStatistics.get();
+	}
+
+	void Client::resetDropCounters()
+	{
+		dropStatistics.reset();
 	}
 
 	void Client::setOnCompromisedCallback(const std::function<void()>& callback)
@@ -196,18 +562,107 @@ namespace EasyIPC
 
 	void Client::setEncryptionStrategy(std::shared_ptr<EncryptionStrategy> strategy)
 	{
-		encryptionStrategy = std::move(strategy);
+		encryptionStrategy = strategy;
+
+		{
+			std::lock_guard<std::mutex> lock(sessionMutex);
+			directStrategy = strategy;
+			broadcastStrategy = strategy;
+		}
+
+		if (connected && usesSessions())
+		{
+			handshakePending = true;
+		}
+	}
+
+	std::shared_ptr<EncryptionStrategy> Client::getDirectStrategy()
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+		return directStrategy;
+	}
+
+	std::shared_ptr<EncryptionStrategy> Client::getBroadcastStrategy()
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+		return broadcastStrategy;
+	}
+
+	bool Client::usesSessions()
+	{
+		return dynamic_cast<SessionEncryptionStrategy*>(encryptionStrategy.get()) != nullptr;
 	}
 
-	void Client::receiveLoop()
+	void Client::performHandshake()
+	{
+		auto* sessions = dynamic_cast<SessionEncryptionStrategy*>(encryptionStrategy.get());
+
+		// control lane, so the handshake doesnt wait behind large requests
+		Lane& lane = lanes[static_cast<size_t>(Priority::Control)];
+		std::lock_guard<std::mutex> lock(lane.reqMutex);
+
+		// the handshake gets its own timeout, the request timeout is back in place once it is done
+		int timeoutMS = requestTimeoutMS;
+		int handshakeTimeout = timeoutMS >= 0 ? std::min(timeoutMS, handshakeTimeoutMS) : handshakeTimeoutMS;
+
+		auto setTimeout = [&lane](int milliseconds)
+		{
+			int returnValue{};
+			if ((returnValue = nng_socket_set_ms(lane.reqSocket->get(), NNG_OPT_SENDTIMEO, milliseconds)) != 0
+				|| (returnValue = nng_socket_set_ms(lane.reqSocket->get(), NNG_OPT_RECVTIMEO, milliseconds)) != 0)
+			{
+				throw std::runtime_error{ "Failed to set handshake timeout: " + std::string(nng_strerror(returnValue)) };
+			}
+		};
+
+		setTimeout(handshakeTimeout);
+
+		SessionEncryptionStrategy::Session session;
+
+		try
+		{
+			session = sessions->handshake([&lane](const std::string& request)
+			{
+				NngMessage message = rawMessage(request);
+
+				int returnValue = message.send(lane.reqSocket->get());
+				if (returnValue != 0)
+				{
+					throw std::runtime_error{ "Failed to send handshake: " + std::string(nng_strerror(returnValue)) };
+				}
+
+				NngMessage response;
+				returnValue = response.receive(lane.reqSocket->get());
+				if (returnValue != 0)
+				{
+					throw std::runtime_error{ "Failed to receive handshake: " + std::string(nng_strerror(returnValue)) };
+				}
+
+				std::span<uint8_t> body = response.body();
+				return std::string(reinterpret_cast<const char*>(body.data()), body.size());
+			});
+		}
+		catch (...)
+		{
+			setTimeout(timeoutMS);
+			throw;
+		}
+
+		setTimeout(timeoutMS);
+
+		std::lock_guard<std::mutex> sessionLock(sessionMutex);
+		directStrategy = session.direct;
+		broadcastStrategy = session.broadcast;
+	}
+
+	void Client::receiveLoop(Lane& lane)
 	{
 		std::cout << "[EasyIPC::Client::receiveLoop] Started...\n";
 
 		while (isRunning)
 		{
-			char* buffer = nullptr;
-			size_t size = 0;
-			int returnValue = nng_recv(subSocket->get(), &buffer, &size, NNG_FLAG_ALLOC);
+			NngMessage message;
+			int returnValue = message.receive(lane.subSocket->get());
 			if (returnValue == NNG_ECLOSED)
 				break;
 
@@ -217,39 +672,233 @@ namespace EasyIPC
 				continue;
 			}
 
-			std::string message(buffer, size);
-			nng_free(buffer, size);
+			handleMessage(message, getBroadcastStrategy().get());
+		}
+	}
+
+	void Client::directReceiveLoop()
+	{
+		bool reconnected = false;
+
+		// failed handshakes are retried after 250ms, 500ms, ... up to 30s, so a server that rejects us isnt flooded
+		constexpr std::chrono::milliseconds firstRetryDelay{ 250 };
+		constexpr std::chrono::milliseconds maxRetryDelay{ 30000 };
+		std::chrono::milliseconds retryDelay{ 0 };
+		std::chrono::steady_clock::time_point nextHandshake{};
+
+		while (isRunning)
+		{
+			if (helloPending.exchange(false))
+			{
+				// the server might have restarted and forgotten our session, the handshake introduces us again
+				if (reconnected && usesSessions())
+				{
+					handshakePending = true;
+				}
+				else
+				{
+					sendHello();
+				}
+
+				reconnected = true;
+			}
+
+			if (std::chrono::steady_clock::now() >= nextHandshake && handshakePending.exchange(false))
+			{
+				try
+				{
+					performHandshake();
+					sendHello();
+					retryDelay = std::chrono::milliseconds{ 0 };
+				}
+				catch (const std::exception& exception)
+				{
+					retryDelay = retryDelay.count() == 0 ? firstRetryDelay : std::min(retryDelay * 2, maxRetryDelay);
+					nextHandshake = std::chrono::steady_clock::now() + retryDelay;
+
+					std::cerr << "[EasyIPC::Client::directReceiveLoop] Handshake failed, retrying in " << retryDelay.count() << "ms: " << exception.what() << std::endl;
+					handshakePending = true;
+				}
+			}
+
+			NngMessage message;
+			int returnValue = message.receive(directSocket->get());
+			if (returnValue == NNG_ECLOSED)
+				break;
+
+			// the timeout only exists so we get to check helloPending regularly
+			if (returnValue == NNG_ETIMEDOUT)
+				continue;
+
+			if (returnValue != 0)
+			{
+				std::cerr << "[EasyIPC::Client::directReceiveLoop] Receive error: " << nng_strerror(returnValue) << std::endl;
+				continue;
+			}
+
+			// events emitted to only this client are handled exactly like broadcasted ones
+			handleMessage(message, getDirectStrategy().get());
+		}
+	}
+
+	void Client::sendHello()
+	{
+		NngMessage message = sealEvent(getDirectStrategy().get(), Protection::Encrypt, writeEnvelopeToThreadBuffer("__hello__", { {"clientId", clientId} }));
+
+		int returnValue = message.send(directSocket->get(), NNG_FLAG_NONBLOCK);
+		if (returnValue != 0)
+		{
+			// try again the next time the receive loop wakes up
+			helloPending = true;
+		}
+	}
+
+	void Client::handleMessage(NngMessage& message, EncryptionStrategy* strategy)
+	{
+		// the records point into the message or the fallback
+		std::string fallback;
+		std::vector<std::string_view> records;
+		Protection protection{};
+
+		try
+		{
+			OpenedEvent opened = openEvent(strategy, message, fallback);
+			protection = opened.protection;
+
+			// a batch is authenticated as a whole, after that its events are handled one by one
+			if (opened.isBatch)
+				records = splitBatch(opened.plainText);
+			else
+				records.push_back(opened.plainText);
+		}
+		catch (const std::exception& exception)
+		{
+			std::cerr << "[EasyIPC::Client::handleMessage] Exception: " << exception.what() << std::endl;
+			dropStatistics.countReceive("");
+			return;
+		}
 
-			handleMessage(message);
+		for (std::string_view record : records)
+		{
+			handleEvent(record, protection);
 		}
 	}
 
-	void Client::handleMessage(const std::string& message)
+	void Client::handleEvent(std::string_view plainText, Protection protection)
 	{
+		// stays empty until the message is parsed
+		std::string event;
+
 		try
 		{
-			std::string plainMessage = message;
+			Envelope envelope = readEnvelope(plainText);
+			std::string messageEvent{ envelope.event };
+
+			// a message that is protected less than its event requires counts as never received
+			checkProtection(messageEvent, protection);
+			event = messageEvent;
 
-			if (encryptionStrategy)
+			// only events emitted to all clients are numbered
+			if (envelope.sequence != 0)
 			{
-				plainMessage = encryptionStrategy->decrypt(message);
+				dropStatistics.trackSequence(event, envelope.sequence);
 			}
 
-			nlohmann::json messageJson = nlohmann::json::parse(plainMessage);
-			std::string event = messageJson["event"];
-			nlohmann::json data = messageJson["data"];
+			EventHandler handler;
+
+			{
+				std::lock_guard<std::mutex> lock(handlerMutex);
+				auto boundHandler = eventHandlers.find(event);
+				if (boundHandler != eventHandlers.end())
+				{
+					handler = boundHandler->second;
+				}
+			}
+
+			// nobody wants it, so dont bother parsing the data
+			if (!handler.handler && !handler.viewHandler && !handler.arenaHandler && !handler.rawHandler)
+			{
+				dropStatistics.countReceive(event);
+				std::cerr << "[EasyIPC::Client::handleEvent] Unknown event: " << event << std::endl;
+				return;
+			}
+
+			std::string_view dataText = envelope.data.empty() ? std::string_view{ "null" } : envelope.data;
+			auto parseOrDrop = [&](auto parse)
+			{
+				try
+				{
+					return parse();
+				}
+				catch (const std::exception&)
+				{
+					dropStatistics.countReceive(event);
+					throw;
+				}
+			};
+
+			// delta encoded events are turned back into the whole value first, handlers dont notice the difference
+			const nlohmann::json* wholeValue = nullptr;
+			std::string wholeText;
+			std::span<const std::byte> rawData = envelope.rawData();
 
-			std::lock_guard<std::mutex> lock(handlerMutex);
-			if (eventHandlers.contains(event))
-				eventHandlers[event](data);
+			if (envelope.kind != EnvelopeKind::Value)
+			{
+				wholeValue = parseOrDrop([&] { return applyDelta(event, envelope); });
+				if (!wholeValue)
+				{
+					dropStatistics.countReceive(event);
+					std::cerr << "[EasyIPC::Client::handleEvent] Skipping delta of " << event << " until the next keyframe.\n";
+					return;
+				}
+
+				// only json handlers can take the value as it is. The others get their own copy,
+				// the thread buffer would be overwritten by an emit() inside the handler.
+				if (!handler.handler)
+				{
+					wholeText = dumpToThreadBuffer(*wholeValue);
+					dataText = wholeText;
+					rawData = std::as_bytes(std::span{ dataText });
+				}
+			}
+
+			// called without holding the lock, otherwise a slow handler of one priority would block the others
+			if (handler.rawHandler)
+			{
+				handler.rawHandler(rawData);
+			}
+			else if (handler.arenaHandler)
+			{
+				// the data has to be gone before the scope releases the arena
+				MessageArena::Scope arenaScope;
+				ArenaJson data = parseOrDrop([&] { return ArenaJson::parse(dataText); });
+				handler.arenaHandler(data);
+			}
+			else if (handler.viewHandler)
+			{
+				DataView::Document document;
+				DataView data = parseOrDrop([&] { return document.parse(dataText); });
+				handler.viewHandler(data);
+			}
+			else if (wholeValue)
+			{
+				handler.handler(*wholeValue);
+			}
 			else
 			{
-				std::cerr << "[EasyIPC::Client::handleMessage] Unknown event: " << event << std::endl;
+				nlohmann::json data = parseOrDrop([&] { return envelope.parseData(); });
+				handler.handler(data);
 			}
 		}
 		catch (const std::exception& exception)
 		{
-			std::cerr << "[EasyIPC::Client::handleMessage] Exception: " << exception.what() << std::endl;
+			std::cerr << "[EasyIPC::Client::handleEvent] Exception: " << exception.what() << std::endl;
+
+			// otherwise it was the handler that threw, the message itself made it
+			if (event.empty())
+			{
+				dropStatistics.countReceive(event);
+			}
 		}
 	}
 
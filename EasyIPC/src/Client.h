@@ -1,16 +1,41 @@
 #pragma once
 
+#include <array>
 #include <mutex>
 #include <thread>
 #include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
 #include <nlohmann/json.hpp>
 
 #include "Encryption/EncryptionStrategy.h"
+#include "ConnectionConfig.h"
+#include "DropCounters.h"
+#include "Priority.h"
+#include "Protection.h"
+#include "DataView.h"
+#include "MessageArena.h"
+#include "Schema.h"
+#include "Attachment.h"
 
 namespace EasyIPC
 {
 	// Forward declare since users of this lib arent supposed to deal with nanomsg
 	class NngSocket;
+	class NngMessage;
+	struct Envelope;
+
+	// Thrown by emit() when the request couldnt be sent or its response never arrived, e.g. because the server is gone
+	// or the request timeout expired. Everything else emit() throws means the server is there, but the emit didnt work out.
+	class TransportError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
 
 	class Client
 	{
@@ -21,17 +46,65 @@ namespace EasyIPC
 
 		// For simple local inter process communication use: tcp://localhost as url and the port the server is listening on.
 		// You HAVE to explicitly call this to connect to the server.
-		void connect(const std::string& url, uint16_t port, int maxRetries = 5, int retryDelayMS = 1000);
+		// The config sets queue depths, the maximum message size and what to drop when the queue of events is full, see ConnectionConfig.
+		void connect(const std::string& url, uint16_t port, int maxRetries = 5, int retryDelayMS = 1000, const ConnectionConfig& config = {});
 		bool isConnected() const;
 
 		void shutdown();
 
+		// Every client has an identity the server can use to address it directly with Server::emitTo().
+		// By default a random id is generated when the client is constructed. If you want the id to survive restarts
+		// of the client process (e.g. "worker-3"), set your own before calling connect().
+		// Ids should be unique among the clients of a server, if two clients use the same id the last one to connect wins.
+		void setClientId(const std::string& id);
+		const std::string& getClientId() const { return clientId; }
+
 		// Attach event handler for specific event, but clients can't respond directly,
 		// instead use .emit() to emit an event with optional data to the server that this client is connected to.
 		// Conceptually clients only react to events and since many clients (processes) can react to an event
 		// no one client can directly answer the message.
 		// This method is equivalent to a subscribe in a publish/subscribe pattern.
-		void on(const std::string& event, std::function<void(const nlohmann::json&)> handler);
+		// Passing a priority is the same as calling setEventPriority, without one the event keeps the priority it has.
+		void on(const std::string& event, std::function<void(const nlohmann::json&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as on(), but the handler gets a read only DataView instead of a nlohmann::json, which is much cheaper
+		// to parse when the library is built with simdjson (see DataView). An event has either an on() or an onView() handler.
+		void onView(const std::string& event, std::function<void(const DataView&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as on(), but the data is parsed into an ArenaJson that allocates from a per thread arena,
+		// which is released at once after the handler returned (see MessageArena). The data must not outlive the handler.
+		void onArena(const std::string& event, std::function<void(const ArenaJson&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// For events emitted with Server::emitRaw, the handler gets the bytes exactly as they were emitted, no json involved.
+		// The bytes are only valid until the handler returns.
+		void onRaw(const std::string& event, std::function<void(std::span<const std::byte>)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// For events emitted with Server::emitFixed, the handler gets the struct back without any parsing, see Schema.h.
+		// Messages with a different layout throw before the handler is called.
+		template<FixedLayout T>
+		void onFixed(const std::string& event, std::function<void(const T&)> handler, std::optional<Priority> priority = std::nullopt)
+		{
+			onRaw(event, [handler](std::span<const std::byte> bytes) { handler(readFixed<T>(bytes)); }, priority);
+		}
+
+		// For events emitted with Server::emitAttachments, the handler gets the json metadata and the attachments,
+		// which point straight into the message and are only valid until the handler returns, see Attachment.
+		template<typename HandlerType>
+		void onAttachments(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt)
+		{
+			onRaw(event, readingAttachments(std::move(handler)), priority);
+		}
+
+		// Events with Priority::Control are sent and received over their own sockets with their own receive thread,
+		// so they never have to wait behind large Priority::Normal messages or slow Priority::Normal handlers.
+		// This decides which sockets emit() uses for the event, the server has to set the same priority for
+		// the events it emits. Note: handlers of different priorities can run at the same time.
+		void setEventPriority(const std::string& event, Priority priority);
+
+		// How this event is protected by the encryption strategy, Protection::Encrypt by default. Applies to emit(), its response
+		// and received events. The server has to set the same protection for the event, messages protected less than expected
+		// are dropped and invoke the compromised callback.
+		void setEventProtection(const std::string& event, Protection protection);
 
 		// Use to emit an event with optional json data to the server this client is connected to.
 		// This is NOT the same as a publish method in the publish/subscribe pattern,
@@ -41,8 +114,39 @@ namespace EasyIPC
 		// The return value is the already parsed response from the server.
 		nlohmann::json emit(const std::string& event, const nlohmann::json& data = {});
 
+		// Same as emit(), but the data are raw bytes, e.g. an image or a protobuf message. They are still protected like
+		// any other event, but never turned into json, so there is no need to base64 them. The server needs an onRaw() handler.
+		// The response is json as usual.
+		nlohmann::json emitRaw(const std::string& event, std::span<const std::byte> data);
+
+		// Emit a struct declared with EASYIPC_SCHEMA, its sent as it is instead of as json, see Schema.h
+		template<FixedLayout T>
+		nlohmann::json emitFixed(const std::string& event, const T& value) { return emitRaw(event, writeFixed(value)); }
+
+		// Emit json metadata together with binary attachments, e.g. a frame with its width and height or a few arrays of samples.
+		// The attachments are copied into the message as they are and protected together with the metadata.
+		// The server needs an onAttachments() handler. The response is json as usual.
+		//
+		// client.emitAttachments("samples", { {"rate", 48000} }, { std::as_bytes(std::span{ left }), std::as_bytes(std::span{ right }) });
+		nlohmann::json emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments);
+
+		// Emit several events as one request, they are authenticated once as a whole instead of one by one,
+		// which saves a lot for small events. The server handles them in order and the responses come back in the same order.
+		// The request is sent with the most urgent priority and the strongest protection of its events.
+		std::vector<nlohmann::json> emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events);
+
+		// How many messages of each event got dropped and where, see DropCounters
+		std::unordered_map<std::string, DropCounters> getDropCounters();
+		void resetDropCounters();
+
+		// How long emit() waits for the server to accept the request and to respond, in milliseconds.
+		// By default it waits forever, which also means emit() blocks forever if the server is gone.
+		// When the timeout expires emit() throws a TransportError. Pass -1 to wait forever again.
+		void setRequestTimeout(int timeoutMS);
+
 		std::string getLastSubSocketDialError() { return lastSubDialError; }
 		std::string getLastReqSocketDialError() { return lastReqDialError; }
+		std::string getLastDirectSocketDialError() { return lastDirectDialError; }
 
 		// If you're using an encryption strategy and the communication is deemed compromised (e.g. message authentication code doesnt match)
 		// then this callback will be invoked, e.g. when someone is trying to tamper with the traffic, think Wireshark.
@@ -54,26 +158,96 @@ namespace EasyIPC
 
 	private:
 
-		void receiveLoop();
-		void handleMessage(const std::string& message);
+		// Each priority has its own pair of sockets and its own thread receiving events
+		struct Lane
+		{
+			std::unique_ptr<NngSocket> subSocket;
+			std::unique_ptr<NngSocket> reqSocket;
+			std::mutex reqMutex;
+			std::thread receiveThread;
+		};
+
+		void receiveLoop(Lane& lane);
+		void directReceiveLoop();
+		void handleMessage(NngMessage& message, EncryptionStrategy* strategy);
+		void handleEvent(std::string_view plainText, Protection protection);
 
-		std::unique_ptr<NngSocket> subSocket;
-		std::unique_ptr<NngSocket> reqSocket;
+		// Turns a keyframe or delta back into the whole value of the event, nothing if the delta doesnt fit the value we have
+		const nlohmann::json* applyDelta(const std::string& event, const Envelope& envelope);
+
+		// emit(), emitRaw() and emitAttachments() only differ in how the data is written into the envelope
+		template<typename Data>
+		nlohmann::json emitData(const std::string& event, const Data& data);
+		void sendHello();
+		void performHandshake();
+		bool usesSessions();
+		void applyRequestTimeout();
+		Priority getEventPriority(const std::string& event);
+		Protection getEventProtection(const std::string& event);
+		void checkProtection(const std::string& event, Protection protection);
+
+		std::array<Lane, priorityCount> lanes;
+		std::unique_ptr<NngSocket> directSocket;
 
 		std::shared_ptr<EncryptionStrategy> encryptionStrategy;
 
-		std::unordered_map<std::string, std::function<void(const nlohmann::json&)>> eventHandlers;
+		// Same as encryptionStrategy, unless it is a SessionEncryptionStrategy: then these are the ciphers of our session
+		// for requests and direct events, and the one for the events the server broadcasts
+		std::shared_ptr<EncryptionStrategy> directStrategy;
+		std::shared_ptr<EncryptionStrategy> broadcastStrategy;
+		std::mutex sessionMutex;
+
+		std::shared_ptr<EncryptionStrategy> getDirectStrategy();
+		std::shared_ptr<EncryptionStrategy> getBroadcastStrategy();
+
+		// Only one of them is set, depending on whether the handler was attached with on(), onView(), onArena() or onRaw()
+		struct EventHandler
+		{
+			std::function<void(const nlohmann::json&)> handler;
+			std::function<void(const DataView&)> viewHandler;
+			std::function<void(const ArenaJson&)> arenaHandler;
+			std::function<void(std::span<const std::byte>)> rawHandler;
+		};
+
+		std::unordered_map<std::string, EventHandler> eventHandlers;
+		std::unordered_map<std::string, Priority> eventPriorities;
+		std::unordered_map<std::string, Protection> eventProtections;
 		std::mutex handlerMutex;
 
-		std::thread receiveThread;
+		DropStatistics dropStatistics;
+
+		// The current value of each delta encoded event the server emits, see Server::setDeltaEncoding
+		struct DeltaValue
+		{
+			nlohmann::json value;
+			uint64_t sequence = 0;
+			bool valid = false;
+		};
+
+		std::unordered_map<std::string, DeltaValue> deltaValues;
+		std::mutex deltaMutex;
+
+		std::thread directReceiveThread;
 		std::atomic<bool> isRunning;
 		std::atomic<bool> connected;
 
+		// Set whenever the direct socket (re)connects, the direct receive loop then introduces us to the server
+		std::atomic<bool> helloPending;
+
+		// Set when the server doesnt know our session (anymore), the direct receive loop then does a new handshake
+		std::atomic<bool> handshakePending;
+		std::string clientId;
+
 		std::string connectUrl;
 		std::string lastSubDialError{};
 		std::string lastReqDialError{};
+		std::string lastDirectDialError{};
+
+		std::atomic<int> requestTimeoutMS;
 
-		std::mutex reqMutex;
+		// The handshake never waits longer than this, even when requests wait forever.
+		// Otherwise connect() would hang on a server that never answers.
+		static constexpr int handshakeTimeoutMS = 5000;
 
 		std::mutex shutdownMutex;
 	};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+namespace EasyIPC
+{
+	// What happens when a receive queue is full and another message arrives
+	enum class OverflowPolicy
+	{
+		// The new message is dropped, the queued ones are kept (nng's default)
+		DropNewest,
+
+		// The oldest queued message is dropped to make room, good for state updates where only the latest matters
+		DropOldest
+	};
+
+	// Passed to Server::serve and Client::connect, applies to every socket they open.
+	// All values of 0 keep nng's defaults.
+	struct ConnectionConfig
+	{
+		// How many messages can be queued for sending per connection before they are dropped (events emitted to all clients)
+		// or sending blocks (everything else)
+		int sendBufferDepth = 0;
+
+		// How many received messages can be queued until the receive thread picks them up
+		int receiveBufferDepth = 0;
+
+		// Incoming messages larger than this (in bytes) are rejected before being buffered,
+		// so a single huge message cant make the process allocate unbounded amounts of memory.
+		// Note: nng closes the connection a too large message came from, the peer reconnects automatically.
+		size_t maxMessageSize = 0;
+
+		// Only applies to the queues of events emitted to all clients, the queues of all other
+		// sockets apply backpressure instead of dropping.
+		OverflowPolicy overflowPolicy = OverflowPolicy::DropNewest;
+	};
+}
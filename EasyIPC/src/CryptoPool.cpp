@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "CryptoPool.h"
+
+#include <iostream>
+
+#include "NngSocket.h"
+#include "DropCounters.h"
+
+namespace EasyIPC
+{
+	CryptoPool::CryptoPool(size_t threadCount) :
+		stopping{ false }
+	{
+		for (size_t i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back(&CryptoPool::workerLoop, this);
+		}
+	}
+
+	CryptoPool::~CryptoPool()
+	{
+		stop();
+	}
+
+	void CryptoPool::post(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+
+		condition.notify_one();
+	}
+
+	void CryptoPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		condition.notify_all();
+
+		for (std::thread& thread : threads)
+		{
+			if (thread.joinable())
+			{
+				thread.join();
+			}
+		}
+	}
+
+	void CryptoPool::workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+				// only quit once everything that was posted is done, otherwise tickets would never complete
+				if (jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+
+	OrderedSender::OrderedSender(NngSocket& socket, DropStatistics& dropStatistics) :
+		socket{ socket },
+		dropStatistics{ dropStatistics },
+		nextTicket{ 0 },
+		nextToSend{ 0 },
+		sending{ false }
+	{
+
+	}
+
+	uint64_t OrderedSender::reserve()
+	{
+		return nextTicket++;
+	}
+
+	void OrderedSender::complete(uint64_t ticket, NngMessage message, std::vector<std::string> events)
+	{
+		std::unique_lock<std::mutex> lock(sendMutex);
+
+		completed.emplace(ticket, Pending{ std::move(message), std::move(events) });
+
+		// the thread that is sending already picks this one up too, that keeps the order without holding the lock while sending
+		if (sending)
+			return;
+
+		sending = true;
+
+		for (auto next = completed.find(nextToSend); next != completed.end(); next = completed.find(nextToSend))
+		{
+			Pending pending = std::move(next->second);
+			completed.erase(next);
+			++nextToSend;
+
+			lock.unlock();
+
+			int returnValue = pending.message ? pending.message.send(socket.get()) : 0;
+
+			// without a message the worker already reported why
+			if (!pending.message || returnValue != 0)
+			{
+				for (const std::string& event : pending.events)
+				{
+					dropStatistics.countSend(event);
+				}
+			}
+
+			if (returnValue != 0)
+			{
+				std::string what = pending.events.size() == 1 ? pending.events.front() : std::to_string(pending.events.size()) + " batched events";
+				std::cerr << "[EasyIPC::OrderedSender::complete] Failed to send " << what << ": " << nng_strerror(returnValue) << "\n";
+			}
+
+			lock.lock();
+		}
+
+		sending = false;
+	}
+}
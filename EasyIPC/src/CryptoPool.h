@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "NngMessage.h"
+
+namespace EasyIPC
+{
+	class NngSocket;
+	class DropStatistics;
+
+	// Threads that encrypt outgoing messages for Server::emit() and Server::emitTo(), see Server::setCryptoWorkers
+	class CryptoPool
+	{
+	public:
+		CryptoPool(size_t threadCount);
+		~CryptoPool();
+
+		void post(std::function<void()> job);
+
+		// Finishes the jobs that are already posted and joins the threads
+		void stop();
+
+	private:
+		void workerLoop();
+
+		std::vector<std::thread> threads;
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping;
+	};
+
+	// The pool encrypts messages in whatever order its threads get to them, this puts them back into the order
+	// they were emitted in before they are sent. Every reserved ticket has to be completed, otherwise nothing after it is sent.
+	class OrderedSender
+	{
+	public:
+		OrderedSender(NngSocket& socket, DropStatistics& dropStatistics);
+
+		uint64_t reserve();
+
+		// Pass an empty message if encrypting failed, it is counted as dropped for each of its events (more than one for batches).
+		// Sends this and every following message that is already done, unless an earlier one is still missing.
+		// The lock is only held to pick the next message, not while it is sent.
+		void complete(uint64_t ticket, NngMessage message, std::vector<std::string> events);
+
+	private:
+		struct Pending
+		{
+			NngMessage message;
+			std::vector<std::string> events;
+		};
+
+		NngSocket& socket;
+		DropStatistics& dropStatistics;
+
+		std::atomic<uint64_t> nextTicket;
+		uint64_t nextToSend;
+		std::map<uint64_t, Pending> completed;
+
+		// Set while one thread sends everything that is ready, others only add to completed meanwhile
+		bool sending;
+		std::mutex sendMutex;
+	};
+}
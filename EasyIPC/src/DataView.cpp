@@ -0,0 +1,314 @@
+#include "pch.h"
+#include "DataView.h"
+
+#include <new>
+#include <limits>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef EASYIPC_USE_SIMDJSON
+#include <simdjson.h>
+#endif
+
+namespace EasyIPC
+{
+	namespace
+	{
+#ifdef EASYIPC_USE_SIMDJSON
+		using Node = simdjson::dom::element;
+
+		template<typename T>
+		T valueOrThrow(simdjson::simdjson_result<T> result)
+		{
+			T value{};
+			if (auto error = std::move(result).get(value))
+			{
+				throw std::runtime_error{ std::string("[EasyIPC::DataView] ") + simdjson::error_message(error) };
+			}
+
+			return value;
+		}
+
+		nlohmann::json toNlohmann(const Node& node)
+		{
+			switch (node.type())
+			{
+				case simdjson::dom::element_type::OBJECT:
+				{
+					nlohmann::json object = nlohmann::json::object();
+					for (simdjson::dom::key_value_pair field : valueOrThrow(node.get_object()))
+					{
+						object.emplace(std::string(field.key), toNlohmann(field.value));
+					}
+					return object;
+				}
+				case simdjson::dom::element_type::ARRAY:
+				{
+					nlohmann::json array = nlohmann::json::array();
+					for (simdjson::dom::element element : valueOrThrow(node.get_array()))
+					{
+						array.push_back(toNlohmann(element));
+					}
+					return array;
+				}
+				case simdjson::dom::element_type::STRING:
+					return std::string(valueOrThrow(node.get_string()));
+				case simdjson::dom::element_type::INT64:
+					return valueOrThrow(node.get_int64());
+				case simdjson::dom::element_type::UINT64:
+					return valueOrThrow(node.get_uint64());
+				case simdjson::dom::element_type::DOUBLE:
+					return valueOrThrow(node.get_double());
+				case simdjson::dom::element_type::BOOL:
+					return valueOrThrow(node.get_bool());
+				case simdjson::dom::element_type::NULL_VALUE:
+				default:
+					return nullptr;
+			}
+		}
+#else
+		// Without simdjson the view points into a document parsed by nlohmann
+		using Node = const nlohmann::json*;
+#endif
+
+		static_assert(sizeof(Node) <= 16 && alignof(Node) <= 8, "DataView::node is too small for the parser's node");
+		static_assert(std::is_trivially_copyable_v<Node>, "DataView is copied around with the node in it");
+
+		const Node& nodeOf(const unsigned char* node)
+		{
+			return *std::launder(reinterpret_cast<const Node*>(node));
+		}
+	}
+
+	struct DataView::Document::Parser
+	{
+#ifdef EASYIPC_USE_SIMDJSON
+		// keeps its buffers between messages, so parsing doesnt allocate once it has seen the largest message
+		simdjson::dom::parser parser;
+#else
+		nlohmann::json document;
+#endif
+	};
+
+	std::vector<std::unique_ptr<DataView::Document::Parser>>& DataView::Document::pool()
+	{
+		thread_local std::vector<std::unique_ptr<Parser>> parsers;
+		return parsers;
+	}
+
+	DataView::Document::Document()
+	{
+		std::vector<std::unique_ptr<Parser>>& parsers = pool();
+
+		if (parsers.empty())
+		{
+			parser = std::make_unique<Parser>();
+		}
+		else
+		{
+			parser = std::move(parsers.back());
+			parsers.pop_back();
+		}
+	}
+
+	DataView::Document::~Document()
+	{
+		pool().push_back(std::move(parser));
+	}
+
+	DataView DataView::Document::parse(std::string_view json)
+	{
+		DataView view;
+
+#ifdef EASYIPC_USE_SIMDJSON
+		// copies into a padded buffer of the parser, simdjson reads a little past the end
+		new (view.node) Node(valueOrThrow(parser->parser.parse(json.data(), json.size(), true)));
+#else
+		parser->document = nlohmann::json::parse(json);
+		new (view.node) Node(&parser->document);
+#endif
+
+		view.valid = true;
+		return view;
+	}
+
+	DataView DataView::operator[](std::string_view key) const
+	{
+		DataView child;
+		if (!valid)
+			return child;
+
+#ifdef EASYIPC_USE_SIMDJSON
+		Node field;
+		if (nodeOf(node).is_object() && !nodeOf(node).at_key(key).get(field))
+		{
+			new (child.node) Node(field);
+			child.valid = true;
+		}
+#else
+		const nlohmann::json& value = *nodeOf(node);
+		if (value.is_object())
+		{
+			auto field = value.find(key);
+			if (field != value.end())
+			{
+				new (child.node) Node(&*field);
+				child.valid = true;
+			}
+		}
+#endif
+
+		return child;
+	}
+
+	DataView DataView::operator[](size_t index) const
+	{
+		DataView child;
+		if (!valid)
+			return child;
+
+#ifdef EASYIPC_USE_SIMDJSON
+		Node element;
+		if (nodeOf(node).is_array() && !nodeOf(node).at(index).get(element))
+		{
+			new (child.node) Node(element);
+			child.valid = true;
+		}
+#else
+		const nlohmann::json& value = *nodeOf(node);
+		if (value.is_array() && index < value.size())
+		{
+			new (child.node) Node(&value[index]);
+			child.valid = true;
+		}
+#endif
+
+		return child;
+	}
+
+#ifdef EASYIPC_USE_SIMDJSON
+	bool DataView::isNull() const { return valid && nodeOf(node).is_null(); }
+	bool DataView::isBool() const { return valid && nodeOf(node).is_bool(); }
+	bool DataView::isNumber() const { return valid && nodeOf(node).is_number(); }
+	bool DataView::isString() const { return valid && nodeOf(node).is_string(); }
+	bool DataView::isArray() const { return valid && nodeOf(node).is_array(); }
+	bool DataView::isObject() const { return valid && nodeOf(node).is_object(); }
+#else
+	bool DataView::isNull() const { return valid && nodeOf(node)->is_null(); }
+	bool DataView::isBool() const { return valid && nodeOf(node)->is_boolean(); }
+	bool DataView::isNumber() const { return valid && nodeOf(node)->is_number(); }
+	bool DataView::isString() const { return valid && nodeOf(node)->is_string(); }
+	bool DataView::isArray() const { return valid && nodeOf(node)->is_array(); }
+	bool DataView::isObject() const { return valid && nodeOf(node)->is_object(); }
+#endif
+
+	bool DataView::asBool() const
+	{
+		if (!valid)
+			throw std::runtime_error{ "[EasyIPC::DataView::asBool] Value doesnt exist" };
+
+#ifdef EASYIPC_USE_SIMDJSON
+		return valueOrThrow(nodeOf(node).get_bool());
+#else
+		return nodeOf(node)->get<bool>();
+#endif
+	}
+
+	int64_t DataView::asInt() const
+	{
+		if (!valid)
+			throw std::runtime_error{ "[EasyIPC::DataView::asInt] Value doesnt exist" };
+
+#ifdef EASYIPC_USE_SIMDJSON
+		return valueOrThrow(nodeOf(node).get_int64());
+#else
+		// nlohmann would convert any number, simdjson only converts integers that fit
+		const nlohmann::json& value = *nodeOf(node);
+		if (value.is_number_unsigned() ? value.get<uint64_t>() > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) : !value.is_number_integer())
+			throw std::runtime_error{ "[EasyIPC::DataView::asInt] Value isnt an integer that fits into int64_t" };
+
+		return value.get<int64_t>();
+#endif
+	}
+
+	uint64_t DataView::asUint() const
+	{
+		if (!valid)
+			throw std::runtime_error{ "[EasyIPC::DataView::asUint] Value doesnt exist" };
+
+#ifdef EASYIPC_USE_SIMDJSON
+		return valueOrThrow(nodeOf(node).get_uint64());
+#else
+		const nlohmann::json& value = *nodeOf(node);
+		if (!value.is_number_unsigned() && !(value.is_number_integer() && value.get<int64_t>() >= 0))
+			throw std::runtime_error{ "[EasyIPC::DataView::asUint] Value isnt an integer that fits into uint64_t" };
+
+		return value.get<uint64_t>();
+#endif
+	}
+
+	double DataView::asDouble() const
+	{
+		if (!valid)
+			throw std::runtime_error{ "[EasyIPC::DataView::asDouble] Value doesnt exist" };
+
+#ifdef EASYIPC_USE_SIMDJSON
+		// integers are stored as integers, but asking for a double is fine
+		return valueOrThrow(nodeOf(node).get_double());
+#else
+		return nodeOf(node)->get<double>();
+#endif
+	}
+
+	std::string_view DataView::asString() const
+	{
+		if (!valid)
+			throw std::runtime_error{ "[EasyIPC::DataView::asString] Value doesnt exist" };
+
+#ifdef EASYIPC_USE_SIMDJSON
+		return valueOrThrow(nodeOf(node).get_string());
+#else
+		return nodeOf(node)->get_ref<const std::string&>();
+#endif
+	}
+
+	size_t DataView::size() const
+	{
+		if (!valid)
+			return 0;
+
+#ifdef EASYIPC_USE_SIMDJSON
+		const Node& value = nodeOf(node);
+		if (value.is_array())
+			return valueOrThrow(value.get_array()).size();
+		if (value.is_object())
+			return valueOrThrow(value.get_object()).size();
+		return 0;
+#else
+		const nlohmann::json& value = *nodeOf(node);
+		return value.is_array() || value.is_object() ? value.size() : 0;
+#endif
+	}
+
+	nlohmann::json DataView::toJson() const
+	{
+		if (!valid)
+			return nullptr;
+
+#ifdef EASYIPC_USE_SIMDJSON
+		return toNlohmann(nodeOf(node));
+#else
+		return *nodeOf(node);
+#endif
+	}
+
+	bool DataView::usesSimdjson()
+	{
+#ifdef EASYIPC_USE_SIMDJSON
+		return true;
+#else
+		return false;
+#endif
+	}
+}
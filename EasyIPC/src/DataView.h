@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+namespace EasyIPC
+{
+	/*
+	Read only access to the data of a received event, for handlers attached with onView().
+	If the library is built with EASYIPC_USE_SIMDJSON the data is parsed with simdjson, which is several times faster
+	than building a nlohmann::json, otherwise it falls back to nlohmann::json behind the same interface.
+
+	client.onView("tick", [](const EasyIPC::DataView& data)
+	{
+		double price = data["price"].asDouble();
+		std::string_view symbol = data["symbol"].asString();
+	});
+
+	A view (and every string_view taken from it) is only valid until the handler returns, copy what you want to keep.
+	Looking up a missing key or index gives a view for which exists() is false, reading a value of the wrong type throws.
+	*/
+	class DataView
+	{
+	public:
+		/*
+		Owns the parsed json the views point into, they are valid as long as the document and until its next parse().
+		The parsers are pooled per thread and keep their buffers, so once warmed up parsing doesnt allocate,
+		and every document that is alive at the same time (e.g. one parsed inside the handler of another) has its own.
+		*/
+		class Document
+		{
+		public:
+			Document();
+			~Document();
+
+			Document(const Document&) = delete;
+			Document& operator=(const Document&) = delete;
+
+			// Parses with the fastest parser available. Throws on invalid json.
+			DataView parse(std::string_view json);
+
+		private:
+			struct Parser;
+
+			// Parsers of the documents of this thread that are gone, handed out again to the next ones
+			static std::vector<std::unique_ptr<Parser>>& pool();
+
+			std::unique_ptr<Parser> parser;
+		};
+
+		DataView operator[](std::string_view key) const;
+		DataView operator[](const char* key) const { return (*this)[std::string_view{ key }]; }
+		DataView operator[](size_t index) const;
+
+		bool exists() const { return valid; }
+		bool isNull() const;
+		bool isBool() const;
+		bool isNumber() const;
+		bool isString() const;
+		bool isArray() const;
+		bool isObject() const;
+
+		bool asBool() const;
+		int64_t asInt() const;
+		uint64_t asUint() const;
+		double asDouble() const;
+		std::string_view asString() const;
+
+		// Elements of an array or fields of an object, 0 for anything else
+		size_t size() const;
+
+		// Builds a nlohmann::json of this value, e.g. to hand it to code that expects one
+		nlohmann::json toJson() const;
+
+		// Whether the library was built with EASYIPC_USE_SIMDJSON
+		static bool usesSimdjson();
+
+	private:
+		DataView() = default;
+
+		// Whatever the parser uses to point at a value, kept opaque so this header doesnt depend on how the library was built
+		alignas(8) unsigned char node[16]{};
+		bool valid = false;
+	};
+}
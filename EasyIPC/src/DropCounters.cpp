@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "DropCounters.h"
+
+namespace EasyIPC
+{
+	namespace
+	{
+		// How far behind the highest sequence number a message may arrive and still count as reordered.
+		// Anything further back is either very late or, if it is one of the first numbers, the server restarted and numbers from 1 again.
+		constexpr uint64_t reorderWindow = 64;
+	}
+
+	void DropStatistics::countSend(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++counters[event].send;
+	}
+
+	void DropStatistics::countInTransit(const std::string& event, uint64_t count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters[event].inTransit += count;
+	}
+
+	void DropStatistics::countReceive(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++counters[event].receive;
+	}
+
+	void DropStatistics::trackSequence(const std::string& event, uint64_t sequence)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto state = sequences.find(event);
+		if (state == sequences.end())
+		{
+			// first one we see, we cant know what got lost before we connected
+			sequences.emplace(event, SequenceState{ sequence, 1 });
+			return;
+		}
+
+		SequenceState& tracked = state->second;
+
+		if (sequence > tracked.highest)
+		{
+			// everything skipped counts as lost until it shows up late
+			uint64_t step = sequence - tracked.highest;
+			counters[event].inTransit += step - 1;
+
+			tracked.seen = step < reorderWindow ? (tracked.seen << step) | 1 : 1;
+			tracked.highest = sequence;
+			return;
+		}
+
+		uint64_t behind = tracked.highest - sequence;
+		if (behind >= reorderWindow)
+		{
+			if (sequence <= reorderWindow)
+			{
+				tracked = { sequence, 1 };
+				return;
+			}
+
+			// just very late. It doesnt move highest back, that would count the gap up to it a second time
+			// with the next message. Events arent sent twice, so it was counted as lost when the ones after it arrived.
+			DropCounters& eventCounters = counters[event];
+			if (eventCounters.inTransit > 0)
+			{
+				--eventCounters.inTransit;
+			}
+
+			return;
+		}
+
+		// a duplicate changes nothing, a late one was counted as lost when the ones after it arrived
+		uint64_t bit = 1ull << behind;
+		if ((tracked.seen & bit) == 0)
+		{
+			tracked.seen |= bit;
+
+			DropCounters& eventCounters = counters[event];
+			if (eventCounters.inTransit > 0)
+			{
+				--eventCounters.inTransit;
+			}
+		}
+	}
+
+	std::unordered_map<std::string, DropCounters> DropStatistics::get()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return counters;
+	}
+
+	void DropStatistics::reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.clear();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+namespace EasyIPC
+{
+	// Messages of one event that got lost, split up by where it happened
+	struct DropCounters
+	{
+		// Sending failed on this side, e.g. a send timeout or the connection was closed
+		uint64_t send = 0;
+
+		// Never arrived, e.g. because a queue on the way was full. Detected by gaps in the sequence numbers
+		// of events emitted to all clients, so only clients count these.
+		uint64_t inTransit = 0;
+
+		// Arrived, but got discarded: no handler was bound for the event, or the message couldnt be decrypted or parsed.
+		// Messages that couldnt be decrypted or parsed are counted for the event "" since their event is unknown.
+		uint64_t receive = 0;
+	};
+
+	// Thread safe per event bookkeeping of dropped messages, used by Server and Client
+	class DropStatistics
+	{
+	public:
+		void countSend(const std::string& event);
+		void countInTransit(const std::string& event, uint64_t count);
+		void countReceive(const std::string& event);
+
+		// Feed the sequence number of every received event emitted to all clients, gaps since the highest sequence number
+		// of the same event are counted as lost in transit. Concurrent emits of one event can go out slightly out of order,
+		// so a message that shows up late is taken off the count again.
+		void trackSequence(const std::string& event, uint64_t sequence);
+
+		std::unordered_map<std::string, DropCounters> get();
+		void reset();
+
+	private:
+		std::unordered_map<std::string, DropCounters> counters;
+		struct SequenceState
+		{
+			uint64_t highest = 0;
+
+			// Bit i is set if highest - i arrived
+			uint64_t seen = 0;
+		};
+
+		std::unordered_map<std::string, SequenceState> sequences;
+		std::mutex mutex;
+	};
+}
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "AeadEncryptionStrategy.h"
+#include "HexKey.h"
+
+#include <cryptopp/aes.h>
+#include <cryptopp/eax.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/chachapoly.h>
+#include <array>
+#include <memory>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	// The cryptopp cipher of each mode
+	template<typename Mode>
+	struct CryptoppCipher;
+
+	template<>
+	struct CryptoppCipher<AesGcmMode>
+	{
+		using Type = CryptoPP::GCM<CryptoPP::AES>;
+	};
+
+	template<>
+	struct CryptoppCipher<AesEaxMode>
+	{
+		using Type = CryptoPP::EAX<CryptoPP::AES>;
+	};
+
+	template<>
+	struct CryptoppCipher<ChaCha20Poly1305Mode>
+	{
+		using Type = CryptoPP::ChaCha20Poly1305;
+	};
+
+	template<typename Mode>
+	struct AeadEncryptionStrategy<Mode>::Ciphers
+	{
+		typename CryptoppCipher<Mode>::Type::Encryption encryptor;
+		typename CryptoppCipher<Mode>::Type::Decryption decryptor;
+	};
+
+	template<typename Mode>
+	AeadEncryptionStrategy<Mode>::AeadEncryptionStrategy(const std::string& hexKey, NonceMode nonceMode, uint64_t replayWindowSize) :
+		encryptionKey{ decodeHexKey(hexKey) },
+		nonces{ nonceMode, Mode::nonceSize, replayWindowSize }
+	{
+
+	}
+
+	template<typename Mode>
+	void AeadEncryptionStrategy<Mode>::seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData)
+	{
+		using namespace CryptoPP;
+
+		constexpr size_t nonceSize = Mode::nonceSize;
+		constexpr size_t tagSize = Mode::tagSize;
+
+		if (buffer.size() < nonceSize + tagSize)
+		{
+			throw std::invalid_argument{ "Buffer has no room for nonce and tag" };
+		}
+
+		// nonce | ciphertext | tag, the plaintext is encrypted right where it is
+		byte* nonce = buffer.data();
+		byte* text = nonce + nonceSize;
+		size_t textSize = buffer.size() - nonceSize - tagSize;
+		byte* tag = text + textSize;
+
+		nonces.generate(nonce);
+
+		threadCiphers().encryptor.EncryptAndAuthenticate(text, tag, tagSize, nonce, static_cast<int>(nonceSize),
+			associatedData.data(), associatedData.size(), text, textSize);
+	}
+
+	template<typename Mode>
+	std::span<uint8_t> AeadEncryptionStrategy<Mode>::open(std::span<uint8_t> message, std::span<const uint8_t> associatedData)
+	{
+		using namespace CryptoPP;
+
+		constexpr size_t nonceSize = Mode::nonceSize;
+		constexpr size_t tagSize = Mode::tagSize;
+
+		if (message.size() < nonceSize + tagSize)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Invalid size" };
+		}
+
+		const byte* nonce = message.data();
+		byte* text = message.data() + nonceSize;
+		size_t textSize = message.size() - nonceSize - tagSize;
+		const byte* tag = text + textSize;
+
+		bool authentic = threadCiphers().decryptor.DecryptAndVerify(text, tag, tagSize, nonce, static_cast<int>(nonceSize),
+			associatedData.data(), associatedData.size(), text, textSize);
+
+		if (!authentic)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Decryption failed: message authentication code doesnt match" };
+		}
+
+		// only checked now, otherwise forged messages could mark counters as seen
+		switch (nonces.accept(nonce))
+		{
+			case NonceCheck::Accepted:
+				break;
+
+			case NonceCheck::TooOld:
+				throw TooOldError{ "Decryption failed: message is further behind than the replay window reaches" };
+
+			case NonceCheck::Replayed:
+			default:
+				reportCompromised();
+				throw std::runtime_error{ "Decryption failed: message was replayed" };
+		}
+
+		return message.subspan(nonceSize, textSize);
+	}
+
+	template<typename Mode>
+	typename AeadEncryptionStrategy<Mode>::Ciphers& AeadEncryptionStrategy<Mode>::threadCiphers()
+	{
+		return ciphers.get([this]
+		{
+			// the nonce of every message is passed to EncryptAndAuthenticate/DecryptAndVerify, this one is never used
+			std::array<uint8_t, Mode::nonceSize> unusedNonce{};
+
+			auto created = std::make_unique<Ciphers>();
+			created->encryptor.SetKeyWithIV(encryptionKey.data(), encryptionKey.size(), unusedNonce.data(), unusedNonce.size());
+			created->decryptor.SetKeyWithIV(encryptionKey.data(), encryptionKey.size(), unusedNonce.data(), unusedNonce.size());
+			return created;
+		});
+	}
+
+	template class AeadEncryptionStrategy<AesGcmMode>;
+	template class AeadEncryptionStrategy<AesEaxMode>;
+	template class AeadEncryptionStrategy<ChaCha20Poly1305Mode>;
+}
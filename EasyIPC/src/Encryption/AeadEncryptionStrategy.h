@@ -0,0 +1,72 @@
+#pragma once
+#include "InPlaceEncryptionStrategy.h"
+#include "Nonces.h"
+#include "PerThread.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace EasyIPC
+{
+	// The authenticated encryption modes the built in strategies are made of, with the sizes of their nonce and tag.
+	// Which cryptopp cipher is behind each of them is only known to AeadEncryptionStrategy.cpp.
+	struct AesGcmMode
+	{
+		static constexpr size_t nonceSize = 12;
+		static constexpr size_t tagSize = 16;
+	};
+
+	struct AesEaxMode
+	{
+		static constexpr size_t nonceSize = 16;
+		static constexpr size_t tagSize = 16;
+	};
+
+	struct ChaCha20Poly1305Mode
+	{
+		static constexpr size_t nonceSize = 12;
+		static constexpr size_t tagSize = 16;
+	};
+
+	/*
+	Everything AesGcmEncryptionStrategy, AesEaxEncryptionStrategy and ChaCha20Poly1305EncryptionStrategy have in common:
+
+	nonce | ciphertext | tag
+
+	The plaintext is encrypted right where it is, the nonce comes from Nonces and counter nonces are checked for replays
+	once the message turned out to be authentic. The subclasses only check the key and add what is special about their algorithm.
+	Implemented (and instantiated for the modes above) in AeadEncryptionStrategy.cpp.
+	*/
+	template<typename Mode>
+	class AeadEncryptionStrategy : public InPlaceEncryptionStrategy
+	{
+	public:
+
+		size_t headroom() const override { return Mode::nonceSize; }
+		size_t tailroom() const override { return Mode::tagSize; }
+
+		void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) override;
+		std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) override;
+
+	protected:
+
+		// Pass the key as a string for convenience (hex encoded)
+		AeadEncryptionStrategy(const std::string& hexKey, NonceMode nonceMode, uint64_t replayWindowSize);
+
+		std::vector<uint8_t> encryptionKey;
+
+	private:
+
+		Nonces nonces;
+
+		// Keyed once per thread and reused for every message, instead of setting up the key schedule every time
+		struct Ciphers;
+		PerThread<Ciphers> ciphers;
+		Ciphers& threadCiphers();
+	};
+
+	extern template class AeadEncryptionStrategy<AesGcmMode>;
+	extern template class AeadEncryptionStrategy<AesEaxMode>;
+	extern template class AeadEncryptionStrategy<ChaCha20Poly1305Mode>;
+}
@@ -1,23 +1,15 @@
 #pragma once
-#include "EncryptionStrategy.h"
+#include "AeadEncryptionStrategy.h"
 
 namespace EasyIPC
 {
-	class AesEaxEncryptionStrategy : public EncryptionStrategy
+	class AesEaxEncryptionStrategy : public AeadEncryptionStrategy<AesEaxMode>
 	{
 	public:
 
 		// Pass the key as a string for convenience (hex encoded)
-		AesEaxEncryptionStrategy(const std::string& hexKey);
-
-		std::string encrypt(const std::string& data) override;
-		std::string decrypt(const std::string& data) override;
-
-	private:
-
-		std::vector<uint8_t> encryptionKey;
-
-		void setKeyFromHexString(const std::string& hexKey);
+		// Use NonceMode::Counter on both sides to reject replayed messages, see NonceMode and ReplayWindow::defaultSize
+		AesEaxEncryptionStrategy(const std::string& hexKey, NonceMode nonceMode = NonceMode::Random, uint64_t replayWindowSize = ReplayWindow::defaultSize);
 	};
 }
 
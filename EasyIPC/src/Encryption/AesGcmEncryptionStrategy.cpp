@@ -0,0 +1,29 @@
+#include "pch.h"
+#include "AesGcmEncryptionStrategy.h"
+
+#include <cryptopp/cpu.h>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	AesGcmEncryptionStrategy::AesGcmEncryptionStrategy(const std::string& hexKey, NonceMode nonceMode, uint64_t replayWindowSize) :
+		AeadEncryptionStrategy{ hexKey, nonceMode, replayWindowSize }
+	{
+		size_t keyLength = encryptionKey.size();
+		if (keyLength != 16 && keyLength != 24 && keyLength != 32)
+		{
+			throw std::invalid_argument{ std::string("Invalid key length ") + std::to_string(encryptionKey.size()) };
+		}
+	}
+
+	bool AesGcmEncryptionStrategy::isHardwareAccelerated()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return CryptoPP::HasAESNI() && CryptoPP::HasCLMUL();
+#elif defined(_M_ARM64) || defined(__aarch64__)
+		return CryptoPP::HasAES() && CryptoPP::HasPMULL();
+#else
+		return false;
+#endif
+	}
+}
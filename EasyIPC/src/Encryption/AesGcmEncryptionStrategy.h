@@ -0,0 +1,22 @@
+#pragma once
+#include "AeadEncryptionStrategy.h"
+
+namespace EasyIPC
+{
+	// AES in GCM mode, like AesEaxEncryptionStrategy it provides confidentiality AND authentication,
+	// but only needs one AES pass per block instead of two. The authentication part (GHASH) runs on the
+	// carry-less multiply instructions (PCLMULQDQ, PMULL on ARM) and AES itself on AES-NI, cryptopp picks
+	// those at runtime whenever the CPU has them.
+	// Both sides have to use the same strategy, its messages are not compatible with AesEaxEncryptionStrategy.
+	class AesGcmEncryptionStrategy : public AeadEncryptionStrategy<AesGcmMode>
+	{
+	public:
+
+		// Pass the key as a string for convenience (hex encoded)
+		// Use NonceMode::Counter on both sides to reject replayed messages, see NonceMode and ReplayWindow::defaultSize
+		AesGcmEncryptionStrategy(const std::string& hexKey, NonceMode nonceMode = NonceMode::Random, uint64_t replayWindowSize = ReplayWindow::defaultSize);
+
+		// Whether this CPU has the instructions GCM needs to be fast, if not consider ChaCha20-Poly1305 instead
+		static bool isHardwareAccelerated();
+	};
+}
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "AutoAeadEncryptionStrategy.h"
+#include "AesGcmEncryptionStrategy.h"
+#include "ChaCha20Poly1305EncryptionStrategy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	AutoAeadEncryptionStrategy::AutoAeadEncryptionStrategy(const std::string& hexKey, const std::vector<AeadAlgorithm>& allowedAlgorithms,
+		NonceMode nonceMode, uint64_t replayWindowSize)
+	{
+		if (allowedAlgorithms.empty())
+		{
+			throw std::invalid_argument{ "At least one algorithm has to be allowed" };
+		}
+
+		for (AeadAlgorithm allowed : allowedAlgorithms)
+		{
+			if (allowed == AeadAlgorithm::AesGcm && !aesGcm)
+			{
+				aesGcm = std::make_unique<AesGcmEncryptionStrategy>(hexKey, nonceMode, replayWindowSize);
+			}
+			else if (allowed == AeadAlgorithm::ChaCha20Poly1305 && !chaCha20Poly1305)
+			{
+				chaCha20Poly1305 = std::make_unique<ChaCha20Poly1305EncryptionStrategy>(hexKey, nonceMode, replayWindowSize);
+			}
+		}
+
+		// take the fastest one if its allowed, otherwise whatever is allowed first
+		AeadAlgorithm fastest = fastestAvailable();
+		bool fastestAllowed = std::find(allowedAlgorithms.begin(), allowedAlgorithms.end(), fastest) != allowedAlgorithms.end();
+		algorithm = fastestAllowed ? fastest : allowedAlgorithms.front();
+		strategy = strategyFor(algorithm);
+	}
+
+	void AutoAeadEncryptionStrategy::seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData)
+	{
+		if (buffer.empty())
+		{
+			throw std::invalid_argument{ "Buffer has no room for the algorithm id" };
+		}
+
+		buffer[0] = static_cast<uint8_t>(algorithm);
+		strategy->seal(buffer.subspan(1), associatedData);
+	}
+
+	std::span<uint8_t> AutoAeadEncryptionStrategy::open(std::span<uint8_t> message, std::span<const uint8_t> associatedData)
+	{
+		InPlaceEncryptionStrategy* messageStrategy = message.empty() ? nullptr : strategyFor(static_cast<AeadAlgorithm>(message[0]));
+
+		if (!messageStrategy)
+		{
+			if (onCompromisedCallback)
+				onCompromisedCallback();
+
+			throw std::runtime_error{ "Decryption failed: algorithm not allowed" };
+		}
+
+		try
+		{
+			return messageStrategy->open(message.subspan(1), associatedData);
+		}
+		catch (const TooOldError&)
+		{
+			// authentic, just late
+			throw;
+		}
+		catch (const std::exception&)
+		{
+			// the inner strategy has no callback of its own
+			if (onCompromisedCallback)
+				onCompromisedCallback();
+
+			throw;
+		}
+	}
+
+	AeadAlgorithm AutoAeadEncryptionStrategy::fastestAvailable()
+	{
+		return AesGcmEncryptionStrategy::isHardwareAccelerated() ? AeadAlgorithm::AesGcm : AeadAlgorithm::ChaCha20Poly1305;
+	}
+
+	InPlaceEncryptionStrategy* AutoAeadEncryptionStrategy::strategyFor(AeadAlgorithm id)
+	{
+		switch (id)
+		{
+			case AeadAlgorithm::AesGcm:
+				return aesGcm.get();
+			case AeadAlgorithm::ChaCha20Poly1305:
+				return chaCha20Poly1305.get();
+			default:
+				return nullptr;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "InPlaceEncryptionStrategy.h"
+#include "Nonces.h"
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace EasyIPC
+{
+	// Ids of the algorithms AutoAeadEncryptionStrategy can pick from, they are part of every message so dont renumber them
+	enum class AeadAlgorithm : uint8_t
+	{
+		AesGcm = 1,
+		ChaCha20Poly1305 = 2
+	};
+
+	/*
+	Encrypts with whichever of the allowed algorithms is fastest on this machine: AES-GCM if the CPU
+	has AES-NI and carry-less multiply, ChaCha20-Poly1305 otherwise. Every message starts with the id of
+	the algorithm it was encrypted with, so the other side can decrypt it no matter what it picked itself.
+
+	Both sides have to use this strategy with the same key and the same allowed algorithms, that is what
+	they agree on. A message using an algorithm that isnt allowed is treated like a failed authentication.
+
+	auto strategy = std::make_shared<EasyIPC::AutoAeadEncryptionStrategy>(aesKeyHex);
+	server.setEncryptionStrategy(strategy);
+	*/
+	class AutoAeadEncryptionStrategy : public InPlaceEncryptionStrategy
+	{
+	public:
+
+		// The key has to be 32 bytes (hex encoded), since ChaCha20-Poly1305 only supports 256 bit keys
+		AutoAeadEncryptionStrategy(const std::string& hexKey,
+			const std::vector<AeadAlgorithm>& allowedAlgorithms = { AeadAlgorithm::AesGcm, AeadAlgorithm::ChaCha20Poly1305 },
+			NonceMode nonceMode = NonceMode::Random, uint64_t replayWindowSize = ReplayWindow::defaultSize);
+
+		// the algorithm id followed by whatever the algorithm itself needs
+		size_t headroom() const override { return 1 + strategy->headroom(); }
+		size_t tailroom() const override { return strategy->tailroom(); }
+
+		void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) override;
+		std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) override;
+
+		// The algorithm this side encrypts with
+		AeadAlgorithm getAlgorithm() const { return algorithm; }
+
+		// The fastest algorithm on this machine, ignoring what is allowed
+		static AeadAlgorithm fastestAvailable();
+
+	private:
+
+		InPlaceEncryptionStrategy* strategyFor(AeadAlgorithm id);
+
+		AeadAlgorithm algorithm;
+
+		// the one we encrypt with
+		InPlaceEncryptionStrategy* strategy;
+
+		// only the allowed ones are set
+		std::unique_ptr<InPlaceEncryptionStrategy> aesGcm;
+		std::unique_ptr<InPlaceEncryptionStrategy> chaCha20Poly1305;
+	};
+}
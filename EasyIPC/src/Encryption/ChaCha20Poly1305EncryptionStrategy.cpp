@@ -0,0 +1,16 @@
+#include "pch.h"
+#include "ChaCha20Poly1305EncryptionStrategy.h"
+
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	ChaCha20Poly1305EncryptionStrategy::ChaCha20Poly1305EncryptionStrategy(const std::string& hexKey, NonceMode nonceMode, uint64_t replayWindowSize) :
+		AeadEncryptionStrategy{ hexKey, nonceMode, replayWindowSize }
+	{
+		if (encryptionKey.size() != 32)
+		{
+			throw std::invalid_argument{ std::string("Invalid key length ") + std::to_string(encryptionKey.size()) };
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "AeadEncryptionStrategy.h"
+
+namespace EasyIPC
+{
+	// ChaCha20-Poly1305 (RFC 8439), provides confidentiality AND authentication like the AES strategies.
+	// It only needs plain integer and SIMD instructions (cryptopp uses SSE2/AVX2 or NEON at runtime),
+	// so on machines without AES-NI it is several times faster than AesEaxEncryptionStrategy or AesGcmEncryptionStrategy.
+	// Both sides have to use the same strategy.
+	class ChaCha20Poly1305EncryptionStrategy : public AeadEncryptionStrategy<ChaCha20Poly1305Mode>
+	{
+	public:
+
+		// Pass the key as a string for convenience (hex encoded), the key has to be 32 bytes
+		// Use NonceMode::Counter on both sides to reject replayed messages, see NonceMode and ReplayWindow::defaultSize
+		ChaCha20Poly1305EncryptionStrategy(const std::string& hexKey, NonceMode nonceMode = NonceMode::Random, uint64_t replayWindowSize = ReplayWindow::defaultSize);
+	};
+}
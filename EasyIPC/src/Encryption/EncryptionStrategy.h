@@ -5,6 +5,13 @@
 
 namespace EasyIPC
 {
+	/*
+	Server and client share one instance between every thread that emits and every thread that receives,
+	so encrypt and decrypt (and seal and open of InPlaceEncryptionStrategy) are called from many threads at once.
+	Implementations have to be thread safe, and shouldnt lock on the hot path either or those threads end up
+	waiting for each other. Keep state that changes per message per thread instead, see PerThread.
+	Set the compromised handler before the strategy is handed to a server or client, it isnt synchronized.
+	*/
 	class EncryptionStrategy
 	{
 	public:
@@ -18,6 +25,13 @@ namespace EasyIPC
 			onCompromisedCallback = callback;
 		}
 
+		// For checks outside of the strategy itself, e.g. the server and client rejecting a downgraded event
+		void reportCompromised()
+		{
+			if (onCompromisedCallback)
+				onCompromisedCallback();
+		}
+
 	protected:
 		std::function<void()> onCompromisedCallback{};
 	};
@@ -0,0 +1,46 @@
+#include "pch.h"
+#include "HexKey.h"
+
+#include <cryptopp/filters.h>
+#include <cryptopp/hex.h>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	std::vector<uint8_t> decodeHexKey(const std::string& hexKey)
+	{
+		using namespace CryptoPP;
+
+		std::vector<uint8_t> key;
+
+		try
+		{
+			StringSource ss(hexKey, true,
+				new HexDecoder(
+					new VectorSink(key)
+				)
+			);
+		}
+		catch (const CryptoPP::Exception& exception)
+		{
+			throw std::invalid_argument("Invalid hex: " + std::string(exception.what()));
+		}
+
+		return key;
+	}
+
+	std::string encodeHexKey(const uint8_t* key, size_t size)
+	{
+		using namespace CryptoPP;
+
+		std::string hexKey;
+
+		StringSource ss(key, size, true,
+			new HexEncoder(
+				new StringSink(hexKey)
+			)
+		);
+
+		return hexKey;
+	}
+}
\ No newline at end of file
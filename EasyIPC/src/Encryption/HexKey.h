@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace EasyIPC
+{
+	// Decodes a hex encoded key as accepted by the provided encryption strategies, throws std::invalid_argument on invalid hex
+	std::vector<uint8_t> decodeHexKey(const std::string& hexKey);
+
+	// The other way around, for handing derived keys to the provided encryption strategies
+	std::string encodeHexKey(const uint8_t* key, size_t size);
+}
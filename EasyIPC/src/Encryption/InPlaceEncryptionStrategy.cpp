@@ -0,0 +1,23 @@
+#include "pch.h"
+#include "InPlaceEncryptionStrategy.h"
+
+namespace EasyIPC
+{
+	std::string InPlaceEncryptionStrategy::encrypt(const std::string& data)
+	{
+		std::string finalMessage(headroom() + data.size() + tailroom(), '\0');
+		std::copy(data.begin(), data.end(), finalMessage.begin() + headroom());
+
+		seal({ reinterpret_cast<uint8_t*>(finalMessage.data()), finalMessage.size() }, {});
+
+		return finalMessage;
+	}
+
+	std::string InPlaceEncryptionStrategy::decrypt(const std::string& data)
+	{
+		std::string message = data;
+		std::span<uint8_t> plainText = open({ reinterpret_cast<uint8_t*>(message.data()), message.size() }, {});
+
+		return { reinterpret_cast<const char*>(plainText.data()), plainText.size() };
+	}
+}
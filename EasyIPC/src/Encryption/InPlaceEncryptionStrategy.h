@@ -0,0 +1,43 @@
+#pragma once
+#include "EncryptionStrategy.h"
+
+#include <span>
+#include <cstdint>
+
+namespace EasyIPC
+{
+	/*
+	Encryption strategy that works on buffers owned by the caller instead of strings.
+	The server and client write the plaintext straight into the outgoing message, leaving room in
+	front of and behind it, and the strategy encrypts it right there. Incoming messages are decrypted
+	inside the received message. So no matter the payload size, no copies are made around encryption.
+
+	All built in strategies derive from this. Strategies that only implement the string based
+	EncryptionStrategy interface still work, they just take the slower path.
+
+	encrypt() and decrypt() are implemented on top of seal() and open(), so you only write those.
+	*/
+	class InPlaceEncryptionStrategy : public EncryptionStrategy
+	{
+	public:
+
+		// How many bytes seal() puts in front of the plaintext, e.g. the nonce
+		virtual size_t headroom() const = 0;
+
+		// How many bytes seal() puts behind the plaintext, e.g. the authentication tag
+		virtual size_t tailroom() const = 0;
+
+		// Encrypts in place. The buffer has to be headroom() free bytes, the plaintext and then tailroom() free bytes,
+		// afterwards the whole buffer is the encrypted message.
+		// The associated data isnt encrypted or sent, but it is authenticated: open() has to be given the same.
+		// Sealing an empty plaintext with the message as associated data authenticates a message without encrypting it.
+		virtual void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) = 0;
+
+		// Decrypts in place and returns the part of the message that is the plaintext.
+		// Throws (and calls the compromised callback) if the message or the associated data isnt authentic.
+		virtual std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) = 0;
+
+		std::string encrypt(const std::string& data) final;
+		std::string decrypt(const std::string& data) final;
+	};
+}
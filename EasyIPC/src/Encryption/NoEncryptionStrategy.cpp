@@ -3,13 +3,13 @@
 
 namespace EasyIPC
 {
-	std::string NoEncryptionStrategy::encrypt(const std::string& data)
+	void NoEncryptionStrategy::seal(std::span<uint8_t>, std::span<const uint8_t>)
 	{
-		return data;
+
 	}
 
-	std::string NoEncryptionStrategy::decrypt(const std::string& data)
+	std::span<uint8_t> NoEncryptionStrategy::open(std::span<uint8_t> message, std::span<const uint8_t>)
 	{
-		return data;
+		return message;
 	}
-}
\ No newline at end of file
+}
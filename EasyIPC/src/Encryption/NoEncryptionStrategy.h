@@ -1,13 +1,16 @@
 #pragma once
-#include "EncryptionStrategy.h"
+#include "InPlaceEncryptionStrategy.h"
 
 namespace EasyIPC
 {
-	class NoEncryptionStrategy : public EncryptionStrategy
+	class NoEncryptionStrategy : public InPlaceEncryptionStrategy
 	{
 	public:
-		std::string encrypt(const std::string& data) override;
-		std::string decrypt(const std::string& data) override;
+		size_t headroom() const override { return 0; }
+		size_t tailroom() const override { return 0; }
+
+		void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) override;
+		std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) override;
 	};
 }
 
@@ -0,0 +1,162 @@
+#include "pch.h"
+#include "Nonces.h"
+
+#include <cryptopp/osrng.h>
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		// Seeding a pool is expensive, so every thread seeds its own once
+		CryptoPP::AutoSeededRandomPool& threadRandomPool()
+		{
+			thread_local CryptoPP::AutoSeededRandomPool rng;
+			return rng;
+		}
+	}
+
+	Nonces::Nonces(NonceMode mode, size_t nonceSize, uint64_t replayWindowSize) :
+		mode{ mode },
+		nonceSize{ nonceSize },
+		maxCounter{},
+		replayWindowSize{ replayWindowSize },
+		prefix{ newPrefix() },
+		sent{ 0 }
+	{
+		size_t counterSize = nonceSize - prefixSize;
+		if (nonceSize <= prefixSize || counterSize > 8)
+		{
+			throw std::invalid_argument{ "Unsupported nonce size " + std::to_string(nonceSize) };
+		}
+
+		maxCounter = counterSize == 8 ? UINT64_MAX : (uint64_t{ 1 } << (counterSize * 8)) - 1;
+	}
+
+	void Nonces::generate(uint8_t* nonce)
+	{
+		if (mode == NonceMode::Random)
+		{
+			threadRandomPool().GenerateBlock(nonce, nonceSize);
+			return;
+		}
+
+		// threads sealing at the same time can send their messages slightly out of order, the replay window allows for that
+		uint64_t value = sent.fetch_add(1, std::memory_order_relaxed);
+
+		size_t counterSize = nonceSize - prefixSize;
+		uint64_t noncePrefix = prefix;
+		uint64_t nonceCounter = value;
+
+		// a nonce must never repeat under the same key, so a used up counter starts over under the next prefix
+		if (counterSize < 8)
+		{
+			noncePrefix += value >> (counterSize * 8);
+			nonceCounter = value & maxCounter;
+		}
+
+		for (size_t i = 0; i < prefixSize; ++i)
+		{
+			nonce[i] = static_cast<uint8_t>(noncePrefix >> (8 * (prefixSize - 1 - i)));
+		}
+
+		for (size_t i = 0; i < counterSize; ++i)
+		{
+			nonce[prefixSize + i] = static_cast<uint8_t>(nonceCounter >> (8 * (counterSize - 1 - i)));
+		}
+	}
+
+	NonceCheck Nonces::accept(const uint8_t* nonce)
+	{
+		if (mode == NonceMode::Random)
+			return NonceCheck::Accepted;
+
+		uint64_t noncePrefix{};
+		for (size_t i = 0; i < prefixSize; ++i)
+		{
+			noncePrefix = (noncePrefix << 8) | nonce[i];
+		}
+
+		uint64_t nonceCounter{};
+		for (size_t i = prefixSize; i < nonceSize; ++i)
+		{
+			nonceCounter = (nonceCounter << 8) | nonce[i];
+		}
+
+		if (isOwnPrefix(noncePrefix))
+			return NonceCheck::Replayed;
+
+		// the low half of a prefix is random, so it spreads them evenly
+		Shard& shard = shards[noncePrefix % shardCount];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto sender = shard.senders.find(noncePrefix);
+		if (sender == shard.senders.end())
+		{
+			// a sender we dropped before picks up where it left off
+			std::optional<uint64_t> resumeAfter;
+
+			auto dropped = shard.droppedSenders.find(noncePrefix);
+			if (dropped != shard.droppedSenders.end())
+			{
+				resumeAfter = dropped->second;
+				shard.droppedSenders.erase(dropped);
+			}
+			else if (creationTime(noncePrefix) <= shard.droppedUpTo)
+			{
+				// we cant tell the first message of a sender we never saw from a replay of one we forgot completely.
+				// It isnt proof of an attack either, so it is only too old.
+				return NonceCheck::TooOld;
+			}
+
+			if (shard.senders.size() >= maxSenders / shardCount)
+			{
+				auto leastRecentlyUsed = std::min_element(shard.senders.begin(), shard.senders.end(), [](const auto& a, const auto& b)
+				{
+					return a.second.lastUsed < b.second.lastUsed;
+				});
+
+				if (shard.droppedSenders.size() >= maxDroppedSenders / shardCount)
+				{
+					auto oldest = shard.droppedSenders.begin();
+					shard.droppedUpTo = std::max(shard.droppedUpTo, creationTime(oldest->first));
+					shard.droppedSenders.erase(oldest);
+				}
+
+				shard.droppedSenders[leastRecentlyUsed->first] = leastRecentlyUsed->second.window.getHighest();
+				shard.senders.erase(leastRecentlyUsed);
+			}
+
+			sender = shard.senders.emplace(noncePrefix, Sender{ ReplayWindow{ replayWindowSize } }).first;
+
+			if (resumeAfter)
+			{
+				sender->second.window.resumeAfter(*resumeAfter);
+			}
+		}
+
+		sender->second.lastUsed = ++shard.acceptCount;
+		return sender->second.window.accept(nonceCounter);
+	}
+
+	bool Nonces::isOwnPrefix(uint64_t noncePrefix) const
+	{
+		size_t counterSize = nonceSize - prefixSize;
+		uint64_t prefixesUsed = counterSize < 8 ? sent.load(std::memory_order_relaxed) >> (counterSize * 8) : 0;
+
+		// wraps around for prefixes below ours, so those are never mistaken for our own
+		return noncePrefix - prefix <= prefixesUsed;
+	}
+
+	uint64_t Nonces::newPrefix()
+	{
+		uint32_t random{};
+		threadRandomPool().GenerateBlock(reinterpret_cast<uint8_t*>(&random), sizeof(random));
+
+		auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+		return (static_cast<uint64_t>(now.count()) << 32) | random;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+
+#include "ReplayWindow.h"
+
+namespace EasyIPC
+{
+	// How the provided encryption strategies come up with the nonce of every message, both sides have to use the same
+	enum class NonceMode
+	{
+		// A new random nonce for every message
+		Random,
+
+		// A prefix per strategy instance followed by a counter that goes up with every message.
+		// Cheaper than drawing random bytes, and the receiver rejects messages it has seen before (replays)
+		// and calls the compromised callback. Messages too far behind to tell are rejected without it, see ReplayWindow.
+		Counter
+	};
+
+	// Creates nonces for sealing and checks nonces of opened messages for replays, thread safe.
+	// Counter nonces are the 8 byte prefix followed by the big endian counter in the remaining bytes.
+	// The prefix is the time the instance was created (seconds, 4 bytes) and 4 random bytes, the counter is one atomic
+	// of the instance, so sealing on many threads at once never waits for a lock and no counter is ever used twice.
+	class Nonces
+	{
+	public:
+		// The replay window only matters for NonceMode::Counter, see ReplayWindow::defaultSize
+		Nonces(NonceMode mode, size_t nonceSize, uint64_t replayWindowSize = ReplayWindow::defaultSize);
+
+		void generate(uint8_t* nonce);
+
+		// Call once the message is authenticated. A message sealed by this instance itself counts as replayed,
+		// since both sides use the same key: a broadcast of the server sent back to its REP socket would authenticate just fine.
+		// Random nonces are always accepted.
+		NonceCheck accept(const uint8_t* nonce);
+
+		NonceMode getMode() const { return mode; }
+
+	private:
+
+		static constexpr size_t prefixSize = 8;
+
+		// Every sender we got messages from keeps a window, once there are this many the least recently used one is dropped.
+		// Only its highest counter is kept (a few bytes instead of the window), so when it comes back everything after that
+		// is accepted again and everything before it is too old.
+		static constexpr size_t maxSenders = 1024;
+
+		// Once this many dropped senders are remembered the oldest one is forgotten completely. Its messages couldnt be told
+		// apart from replays anymore, so from then on senders we never saw that arent newer than it are rejected as too old,
+		// see Shard::droppedUpTo. Only happens with hundreds of thousands of strategy instances talking to one receiver.
+		static constexpr size_t maxDroppedSenders = 1 << 18;
+
+		// The senders are spread over shards by prefix, so threads opening messages of different senders dont wait for each other
+		static constexpr size_t shardCount = 16;
+
+		struct Sender
+		{
+			ReplayWindow window;
+			uint64_t lastUsed = 0;
+		};
+
+		struct Shard
+		{
+			std::unordered_map<uint64_t, Sender> senders;
+			uint64_t acceptCount = 0;
+
+			// Highest counter of every sender whose window was dropped, by prefix and with that oldest first
+			std::map<uint64_t, uint64_t> droppedSenders;
+
+			// Creation time of the newest sender that was forgotten completely
+			uint32_t droppedUpTo = 0;
+			std::mutex mutex;
+		};
+
+		static uint64_t newPrefix();
+		bool isOwnPrefix(uint64_t noncePrefix) const;
+		static uint32_t creationTime(uint64_t prefix) { return static_cast<uint32_t>(prefix >> 32); }
+
+		NonceMode mode;
+		size_t nonceSize;
+		uint64_t maxCounter;
+		uint64_t replayWindowSize;
+
+		// Every time the counter is used up the prefix goes up by one, so a nonce never repeats
+		uint64_t prefix;
+		std::atomic<uint64_t> sent;
+
+		std::array<Shard, shardCount> shards;
+	};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+namespace EasyIPC
+{
+	/*
+	One T per thread and owner, e.g. cipher objects that are keyed once and then reused for every message,
+	so threads encrypting with the same strategy never share (or lock) any state.
+
+	The values belong to the owner and are destroyed with it, so e.g. key material doesnt outlive the strategy.
+	Every thread finds its value through a small per thread cache of pointers, keyed by an owner id that is never reused.
+	When the cache is full the least recently used pointer is dropped, the next get() of that thread then looks its value up
+	at the owner again (under a lock), the value itself is never recreated. Threads that exit leave their value at the owner
+	until it is destroyed.
+
+	Only get() needs T to be complete, so a header can declare a PerThread of a type that is defined in the .cpp
+	*/
+	template<typename T>
+	class PerThread
+	{
+	public:
+		PerThread() : id{ nextId()++ } {}
+
+		PerThread(const PerThread&) = delete;
+		PerThread& operator=(const PerThread&) = delete;
+
+		// The value of the calling thread, create() makes it (returning a std::unique_ptr<T>) if this thread doesnt have one yet
+		template<typename Create>
+		T& get(Create&& create)
+		{
+			std::vector<Entry>& entries = cache();
+
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				if (entries[i].first == id)
+				{
+					// move to the front, so the least recently used one is always the last
+					if (i != 0)
+					{
+						std::rotate(entries.begin(), entries.begin() + i, entries.begin() + i + 1);
+					}
+
+					return *entries.front().second;
+				}
+			}
+
+			T* value = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				Owned& owned = values.try_emplace(std::this_thread::get_id(), nullptr, [](T* value) { delete value; }).first->second;
+				if (!owned)
+				{
+					owned.reset(create().release());
+				}
+
+				value = owned.get();
+			}
+
+			if (entries.size() >= capacity)
+			{
+				entries.pop_back();
+			}
+
+			entries.insert(entries.begin(), Entry{ id, value });
+			return *value;
+		}
+
+	private:
+		// The deleter is picked in get(), where T is complete
+		using Owned = std::unique_ptr<T, void (*)(T*)>;
+
+		// Pointers of owners that are gone stay until they age out, they are never looked at since ids arent reused
+		using Entry = std::pair<uint64_t, T*>;
+
+		// Per thread and T, small enough to search linearly
+		static constexpr size_t capacity = 32;
+
+		static std::vector<Entry>& cache()
+		{
+			thread_local std::vector<Entry> entries;
+			return entries;
+		}
+
+		static std::atomic<uint64_t>& nextId()
+		{
+			static std::atomic<uint64_t> id{ 1 };
+			return id;
+		}
+
+		uint64_t id;
+
+		std::unordered_map<std::thread::id, Owned> values;
+		std::mutex mutex;
+	};
+}
@@ -0,0 +1,54 @@
+#include "pch.h"
+#include "ReplayWindow.h"
+
+#include <algorithm>
+
+namespace EasyIPC
+{
+	ReplayWindow::ReplayWindow(uint64_t size) :
+		size{ std::max<uint64_t>((size + 63) / 64, 1) * 64 },
+		blocks(this->size / 64 + 1, 0)
+	{
+
+	}
+
+	void ReplayWindow::resumeAfter(uint64_t counter)
+	{
+		std::fill(blocks.begin(), blocks.end(), 0);
+		highest = counter;
+		minimum = counter + 1;
+	}
+
+	NonceCheck ReplayWindow::accept(uint64_t counter)
+	{
+		// highest - counter instead of counter + size, which would overflow for counters close to the end of the range
+		if (counter < minimum || (counter < highest && highest - counter >= size))
+			return NonceCheck::TooOld;
+
+		uint64_t blockCount = blocks.size();
+		uint64_t block = counter / 64;
+
+		if (counter > highest)
+		{
+			uint64_t highestBlock = highest / 64;
+
+			// a jump larger than the whole window clears everything
+			uint64_t skipped = std::min<uint64_t>(block - highestBlock, blockCount);
+			for (uint64_t i = 1; i <= skipped; ++i)
+			{
+				blocks[(highestBlock + i) % blockCount] = 0;
+			}
+
+			highest = counter;
+		}
+
+		uint64_t& bits = blocks[block % blockCount];
+		uint64_t bit = uint64_t{ 1 } << (counter % 64);
+
+		if (bits & bit)
+			return NonceCheck::Replayed;
+
+		bits |= bit;
+		return NonceCheck::Accepted;
+	}
+}
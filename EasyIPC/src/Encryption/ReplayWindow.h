@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	// What the receiver makes of the counter of an authentic message
+	enum class NonceCheck
+	{
+		Accepted,
+
+		// Further behind the highest counter than the window reaches. It might be a replay, but more likely
+		// it waited in a queue for longer than the window covers, so it isnt treated as an attack.
+		TooOld,
+
+		// Seen before, or sealed by the receiving instance itself
+		Replayed
+	};
+
+	// Thrown by open() for an authentic message whose counter is NonceCheck::TooOld, unlike a replay it doesnt invoke the compromised callback
+	class TooOldError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	// Remembers which message counters of one sender were already seen, within a window behind the highest one.
+	// Checking a counter is O(1) no matter how far the window has to move: the bitmap is a ring of 64 bit blocks
+	// and moving forward only clears the blocks that are skipped (RFC 6479).
+	class ReplayWindow
+	{
+	public:
+
+		// How far a counter can be behind the highest one seen and still be accepted, by default.
+		// Messages can arrive out of order since every priority has its own sockets, and a sender uses one counter for
+		// everything it seals: a deep queue of Priority::Normal events to one client falls behind everything the sender
+		// sealed in the meantime, for all clients and lanes. Costs size / 8 bytes per sender.
+		static constexpr uint64_t defaultSize = 1 << 16;
+
+		// The size is rounded up to a multiple of 64
+		explicit ReplayWindow(uint64_t size = defaultSize);
+
+		// Marks the counter as seen if it is accepted
+		NonceCheck accept(uint64_t counter);
+
+		// The highest counter accepted so far
+		uint64_t getHighest() const { return highest; }
+
+		// For a sender whose window was dropped before: everything up to highest counts as too old, everything after it is new
+		void resumeAfter(uint64_t highest);
+
+	private:
+
+		uint64_t size;
+
+		// counters below this are too old no matter what the window says, see resumeAfter
+		uint64_t minimum = 0;
+
+		// one more block than the window needs, so moving forward never clears bits that are still in the window
+		std::vector<uint64_t> blocks;
+		uint64_t highest = 0;
+	};
+}
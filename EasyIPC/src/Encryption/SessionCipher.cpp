@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "SessionCipher.h"
+#include "AutoAeadEncryptionStrategy.h"
+#include "HexKey.h"
+
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	SessionCipher::SessionCipher(uint64_t id, std::optional<Key> sendKey, uint8_t sendEpoch, std::optional<Key> receiveKey, uint8_t receiveEpoch,
+		RekeyPolicy rekeyPolicy, uint64_t replayWindowSize, std::function<void()> onCompromised) :
+		id{ id },
+		rekeyPolicy{ rekeyPolicy },
+		replayWindowSize{ replayWindowSize },
+		innerHeadroom{ 0 },
+		innerTailroom{ 0 },
+		sentMessages{ 0 },
+		sentBytes{ 0 }
+	{
+		setOnCompromisedHandler(onCompromised);
+
+		if (sendKey)
+		{
+			sending = makeEpoch(sendEpoch, *sendKey);
+		}
+
+		if (receiveKey)
+		{
+			receiving = makeEpoch(receiveEpoch, *receiveKey);
+		}
+
+		// every epoch picks the same algorithm, so this never changes
+		const Epoch& epoch = sending ? *sending : *receiving;
+		innerHeadroom = epoch.cipher->headroom();
+		innerTailroom = epoch.cipher->tailroom();
+	}
+
+	void SessionCipher::seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData)
+	{
+		if (buffer.size() < headroom() + tailroom())
+		{
+			throw std::invalid_argument{ "Buffer has no room for header and tag" };
+		}
+
+		std::shared_ptr<InPlaceEncryptionStrategy> cipher;
+		uint8_t epoch{};
+
+		{
+			std::lock_guard<std::mutex> lock(sendMutex);
+
+			if (!sending)
+			{
+				throw std::runtime_error{ "This session only receives" };
+			}
+
+			if (sentMessages >= rekeyPolicy.maxMessages || sentBytes >= rekeyPolicy.maxBytes)
+			{
+				sending = makeEpoch(static_cast<uint8_t>(sending->number + 1), nextKey(sending->key));
+				sentMessages = 0;
+				sentBytes = 0;
+			}
+
+			++sentMessages;
+			sentBytes += buffer.size();
+
+			cipher = sending->cipher;
+			epoch = sending->number;
+		}
+
+		for (size_t i = 0; i < 8; ++i)
+		{
+			buffer[i] = static_cast<uint8_t>(id >> (8 * (7 - i)));
+		}
+
+		buffer[8] = epoch;
+
+		// the expensive part happens without holding the lock
+		cipher->seal(buffer.subspan(headerSize), associatedData);
+	}
+
+	std::span<uint8_t> SessionCipher::open(std::span<uint8_t> message, std::span<const uint8_t> associatedData)
+	{
+		if (message.size() < headerSize || readId(message) != id)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Decryption failed: message doesnt belong to this session" };
+		}
+
+		uint8_t epochNumber = message[8];
+		std::optional<Epoch> ahead;
+		std::shared_ptr<InPlaceEncryptionStrategy> cipher;
+
+		{
+			std::lock_guard<std::mutex> lock(receiveMutex);
+
+			if (!receiving)
+			{
+				throw std::runtime_error{ "This session only sends" };
+			}
+
+			if (epochNumber == receiving->number)
+			{
+				cipher = receiving->cipher;
+			}
+			else if (previousReceiving && epochNumber == previousReceiving->number)
+			{
+				cipher = previousReceiving->cipher;
+			}
+			else
+			{
+				uint8_t distance = static_cast<uint8_t>(epochNumber - receiving->number);
+				if (distance <= maxEpochsAhead)
+				{
+					Key key = receiving->key;
+					for (uint8_t step = 0; step < distance; ++step)
+					{
+						key = nextKey(key);
+					}
+
+					// only used once the message turns out to be authentic, otherwise anyone could move us forward
+					ahead = makeEpoch(epochNumber, key);
+					cipher = ahead->cipher;
+				}
+			}
+		}
+
+		if (!cipher)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Decryption failed: unknown key epoch" };
+		}
+
+		std::span<uint8_t> plainText;
+
+		try
+		{
+			plainText = cipher->open(message.subspan(headerSize), associatedData);
+		}
+		catch (const TooOldError&)
+		{
+			// authentic, just late
+			throw;
+		}
+		catch (const std::exception&)
+		{
+			// the inner strategy has no callback of its own
+			reportCompromised();
+			throw;
+		}
+
+		if (ahead)
+		{
+			std::lock_guard<std::mutex> lock(receiveMutex);
+
+			// another thread might have moved on already
+			uint8_t distance = static_cast<uint8_t>(ahead->number - receiving->number);
+			if (distance != 0 && distance <= maxEpochsAhead)
+			{
+				previousReceiving = std::move(receiving);
+				receiving = std::move(ahead);
+			}
+		}
+
+		return plainText;
+	}
+
+	std::pair<SessionCipher::Key, uint8_t> SessionCipher::getSendKey()
+	{
+		std::lock_guard<std::mutex> lock(sendMutex);
+
+		if (!sending)
+		{
+			throw std::runtime_error{ "This session only receives" };
+		}
+
+		return { sending->key, sending->number };
+	}
+
+	uint64_t SessionCipher::readId(std::span<const uint8_t> message)
+	{
+		uint64_t id{};
+		for (size_t i = 0; i < 8 && i < message.size(); ++i)
+		{
+			id = (id << 8) | message[i];
+		}
+
+		return id;
+	}
+
+	SessionCipher::Epoch SessionCipher::makeEpoch(uint8_t number, const Key& key)
+	{
+		// counter nonces, every epoch has a fresh key so they can start over at 0
+		auto cipher = std::make_shared<AutoAeadEncryptionStrategy>(encodeHexKey(key.data(), key.size()),
+			std::vector<AeadAlgorithm>{ AeadAlgorithm::AesGcm, AeadAlgorithm::ChaCha20Poly1305 }, NonceMode::Counter, replayWindowSize);
+
+		return { number, key, cipher };
+	}
+
+	SessionCipher::Key SessionCipher::nextKey(const Key& key)
+	{
+		static constexpr char info[] = "EasyIPC rekey";
+
+		Key next{};
+		CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+		hkdf.DeriveKey(next.data(), next.size(), key.data(), key.size(), nullptr, 0,
+			reinterpret_cast<const CryptoPP::byte*>(info), sizeof(info) - 1);
+
+		return next;
+	}
+}
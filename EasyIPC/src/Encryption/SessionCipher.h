@@ -0,0 +1,86 @@
+#pragma once
+#include "InPlaceEncryptionStrategy.h"
+#include "ReplayWindow.h"
+
+#include <array>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <functional>
+
+namespace EasyIPC
+{
+	// When SessionEncryptionStrategy replaces a key, whichever comes first
+	struct RekeyPolicy
+	{
+		uint64_t maxMessages = 1ull << 20;
+		uint64_t maxBytes = 1ull << 30;
+	};
+
+	/*
+	Encrypts the messages of one session, or the broadcasts of a server, see SessionEncryptionStrategy.
+	Each direction has its own key. After RekeyPolicy messages or bytes the sender moves on to the next
+	key, which is derived from the current one, and bumps the epoch that is sent in front of every message:
+
+	session id (8) | epoch (1) | AutoAeadEncryptionStrategy message
+
+	The receiver derives the same next key once it sees the new epoch, so rekeying needs no extra messages
+	and never waits for the other side. The previous key stays usable for messages that were still on the way.
+	*/
+	class SessionCipher : public InPlaceEncryptionStrategy
+	{
+	public:
+		using Key = std::array<uint8_t, 32>;
+
+		// Leave out the send or receive key if this side only does one of the two, e.g. clients never send broadcasts
+		SessionCipher(uint64_t id, std::optional<Key> sendKey, uint8_t sendEpoch, std::optional<Key> receiveKey, uint8_t receiveEpoch,
+			RekeyPolicy rekeyPolicy, uint64_t replayWindowSize, std::function<void()> onCompromised);
+
+		uint64_t getId() const { return id; }
+
+		size_t headroom() const override { return headerSize + innerHeadroom; }
+		size_t tailroom() const override { return innerTailroom; }
+
+		void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) override;
+		std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) override;
+
+		// The key and epoch the next message is sent with, a server hands this to new clients for its broadcasts
+		std::pair<Key, uint8_t> getSendKey();
+
+		// Every message starts with the id of the session it belongs to
+		static uint64_t readId(std::span<const uint8_t> message);
+
+		static constexpr size_t headerSize = 9;
+
+	private:
+
+		struct Epoch
+		{
+			uint8_t number;
+			Key key;
+			std::shared_ptr<InPlaceEncryptionStrategy> cipher;
+		};
+
+		Epoch makeEpoch(uint8_t number, const Key& key);
+		static Key nextKey(const Key& key);
+
+		// How many epochs a received message may be ahead, e.g. when we missed everything sent with the keys in between
+		static constexpr uint8_t maxEpochsAhead = 16;
+
+		uint64_t id;
+		RekeyPolicy rekeyPolicy;
+		uint64_t replayWindowSize;
+
+		size_t innerHeadroom;
+		size_t innerTailroom;
+
+		std::optional<Epoch> sending;
+		uint64_t sentMessages;
+		uint64_t sentBytes;
+		std::mutex sendMutex;
+
+		std::optional<Epoch> receiving;
+		std::optional<Epoch> previousReceiving;
+		std::mutex receiveMutex;
+	};
+}
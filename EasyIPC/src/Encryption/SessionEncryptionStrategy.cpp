@@ -0,0 +1,384 @@
+#include "pch.h"
+#include "SessionEncryptionStrategy.h"
+#include "HexKey.h"
+
+#include <cryptopp/hkdf.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/xed25519.h>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		constexpr size_t publicKeySize = 32;
+		constexpr size_t macSize = 32;
+		constexpr size_t controlHeaderSize = 9;
+		constexpr size_t timestampSize = 8;
+
+		void appendId(std::string& message, uint64_t id)
+		{
+			for (size_t i = 0; i < 8; ++i)
+			{
+				message.push_back(static_cast<char>(id >> (8 * (7 - i))));
+			}
+		}
+
+		// milliseconds since the epoch, hellos carry it so they cant be replayed later
+		int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		template<typename Container>
+		void append(std::string& message, const Container& bytes)
+		{
+			message.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		}
+
+		std::span<const uint8_t> asBytes(const std::string& message)
+		{
+			return { reinterpret_cast<const uint8_t*>(message.data()), message.size() };
+		}
+
+		SessionCipher::Key randomKey()
+		{
+			SessionCipher::Key key{};
+			CryptoPP::AutoSeededRandomPool rng;
+			rng.GenerateBlock(key.data(), key.size());
+			return key;
+		}
+
+		// Both directions get their own key, derived from the key exchange and bound to the pre-shared key and both public keys
+		std::pair<SessionCipher::Key, SessionCipher::Key> deriveSessionKeys(const uint8_t* sharedSecret, const std::vector<uint8_t>& preSharedKey,
+			std::span<const uint8_t> clientPublicKey, std::span<const uint8_t> serverPublicKey)
+		{
+			std::string info = "EasyIPC session";
+			info.append(reinterpret_cast<const char*>(clientPublicKey.data()), clientPublicKey.size());
+			info.append(reinterpret_cast<const char*>(serverPublicKey.data()), serverPublicKey.size());
+
+			std::array<uint8_t, 64> keys{};
+			CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+			hkdf.DeriveKey(keys.data(), keys.size(), sharedSecret, CryptoPP::x25519::SHARED_KEYLENGTH,
+				preSharedKey.data(), preSharedKey.size(), reinterpret_cast<const CryptoPP::byte*>(info.data()), info.size());
+
+			SessionCipher::Key clientToServer{};
+			SessionCipher::Key serverToClient{};
+			std::copy(keys.begin(), keys.begin() + 32, clientToServer.begin());
+			std::copy(keys.begin() + 32, keys.end(), serverToClient.begin());
+
+			return { clientToServer, serverToClient };
+		}
+	}
+
+	SessionEncryptionStrategy::SessionEncryptionStrategy(const std::string& preSharedHexKey, RekeyPolicy rekeyPolicy, uint64_t replayWindowSize) :
+		preSharedKey{ decodeHexKey(preSharedHexKey) },
+		rekeyPolicy{ rekeyPolicy },
+		replayWindowSize{ replayWindowSize },
+		sessionCount{ 0 }
+	{
+		if (preSharedKey.empty())
+		{
+			throw std::invalid_argument{ "The pre-shared key cant be empty" };
+		}
+
+		broadcastCipher = std::make_shared<SessionCipher>(0, randomKey(), 0, std::nullopt, 0, rekeyPolicy, replayWindowSize, [this] { reportCompromised(); });
+	}
+
+	size_t SessionEncryptionStrategy::headroom() const
+	{
+		return broadcastCipher->headroom();
+	}
+
+	size_t SessionEncryptionStrategy::tailroom() const
+	{
+		return broadcastCipher->tailroom();
+	}
+
+	void SessionEncryptionStrategy::seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData)
+	{
+		broadcastCipher->seal(buffer, associatedData);
+	}
+
+	std::span<uint8_t> SessionEncryptionStrategy::open(std::span<uint8_t>, std::span<const uint8_t>)
+	{
+		throw std::runtime_error{ "Received messages are opened with the cipher of their session" };
+	}
+
+	SessionEncryptionStrategy::Session SessionEncryptionStrategy::handshake(const std::function<std::string(const std::string&)>& exchange)
+	{
+		using namespace CryptoPP;
+
+		AutoSeededRandomPool rng;
+		x25519 keyExchange;
+
+		std::array<uint8_t, x25519::SECRET_KEYLENGTH> privateKey{};
+		std::array<uint8_t, publicKeySize> publicKey{};
+		keyExchange.GenerateKeyPair(rng, privateKey.data(), publicKey.data());
+
+		// session id 0 | Hello | client public key | timestamp | mac over key and timestamp
+		std::string hello;
+		appendId(hello, 0);
+		hello.push_back(static_cast<char>(MessageType::Hello));
+		append(hello, publicKey);
+		appendId(hello, static_cast<uint64_t>(now()));
+		append(hello, mac("EasyIPC hello", asBytes(hello).subspan(controlHeaderSize)));
+
+		std::string welcome = exchange(hello);
+		std::span<const uint8_t> message = asBytes(welcome);
+
+		if (message.size() < controlHeaderSize || SessionCipher::readId(message) != 0)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Handshake failed: unexpected response" };
+		}
+
+		if (message[8] == static_cast<uint8_t>(MessageType::Rejected))
+		{
+			throw std::runtime_error{ "Handshake failed: the server rejected us, do both sides use the same pre-shared key and are their clocks in sync?" };
+		}
+
+		// session id 0 | Welcome | server public key | session id | mac | broadcast key, encrypted for this session
+		size_t welcomeSize = controlHeaderSize + publicKeySize + 8 + macSize;
+		if (message[8] != static_cast<uint8_t>(MessageType::Welcome) || message.size() <= welcomeSize)
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Handshake failed: unexpected response" };
+		}
+
+		std::span<const uint8_t> serverPublicKey = message.subspan(controlHeaderSize, publicKeySize);
+		std::span<const uint8_t> sessionIdBytes = message.subspan(controlHeaderSize + publicKeySize, 8);
+		std::span<const uint8_t> serverMac = message.subspan(controlHeaderSize + publicKeySize + 8, macSize);
+
+		std::string transcript;
+		append(transcript, publicKey);
+		append(transcript, serverPublicKey);
+		append(transcript, sessionIdBytes);
+
+		SessionCipher::Key expectedMac = mac("EasyIPC welcome", asBytes(transcript));
+		if (!VerifyBufsEqual(expectedMac.data(), serverMac.data(), macSize))
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Handshake failed: the response isnt authentic" };
+		}
+
+		std::array<uint8_t, x25519::SHARED_KEYLENGTH> sharedSecret{};
+		if (!keyExchange.Agree(sharedSecret.data(), privateKey.data(), serverPublicKey.data()))
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Handshake failed: invalid server public key" };
+		}
+
+		auto [clientToServer, serverToClient] = deriveSessionKeys(sharedSecret.data(), preSharedKey, publicKey, serverPublicKey);
+		uint64_t sessionId = SessionCipher::readId(sessionIdBytes);
+
+		Session session;
+		session.direct = std::make_shared<SessionCipher>(sessionId, clientToServer, 0, serverToClient, 0, rekeyPolicy, replayWindowSize, [this] { reportCompromised(); });
+
+		// broadcast epoch | broadcast key
+		std::string sealedBroadcastKey(welcome.begin() + welcomeSize, welcome.end());
+		std::span<uint8_t> broadcastKey = session.direct->open({ reinterpret_cast<uint8_t*>(sealedBroadcastKey.data()), sealedBroadcastKey.size() }, {});
+
+		if (broadcastKey.size() != 1 + sizeof(SessionCipher::Key))
+		{
+			reportCompromised();
+			throw std::runtime_error{ "Handshake failed: invalid broadcast key" };
+		}
+
+		SessionCipher::Key key{};
+		std::copy(broadcastKey.begin() + 1, broadcastKey.end(), key.begin());
+
+		session.broadcast = std::make_shared<SessionCipher>(0, std::nullopt, 0, key, broadcastKey[0], rekeyPolicy, replayWindowSize, [this] { reportCompromised(); });
+
+		return session;
+	}
+
+	std::shared_ptr<SessionCipher> SessionEncryptionStrategy::findSession(std::span<const uint8_t> message)
+	{
+		uint64_t id = SessionCipher::readId(message);
+		if (message.size() < SessionCipher::headerSize || id == 0)
+			return nullptr;
+
+		std::lock_guard<std::mutex> lock(sessionMutex);
+
+		auto session = sessions.find(id);
+		return session != sessions.end() ? session->second.cipher : nullptr;
+	}
+
+	std::string SessionEncryptionStrategy::respond(std::span<const uint8_t> message)
+	{
+		bool isHello = message.size() >= controlHeaderSize && SessionCipher::readId(message) == 0
+			&& message[8] == static_cast<uint8_t>(MessageType::Hello);
+
+		return isHello ? respondToHello(message) : controlMessage(MessageType::UnknownSession);
+	}
+
+	std::string SessionEncryptionStrategy::reject()
+	{
+		return controlMessage(MessageType::Rejected);
+	}
+
+	void SessionEncryptionStrategy::bindSession(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+
+		auto session = sessions.find(id);
+		if (session == sessions.end() || session->second.bound)
+			return;
+
+		session->second.bound = true;
+		unboundByAge.erase(session->second.age);
+	}
+
+	void SessionEncryptionStrategy::endSession(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(sessionMutex);
+
+		auto session = sessions.find(id);
+		if (session == sessions.end())
+			return;
+
+		unboundByAge.erase(session->second.age);
+		sessions.erase(session);
+	}
+
+	bool SessionEncryptionStrategy::isUnknownSession(std::span<const uint8_t> message)
+	{
+		return message.size() == controlHeaderSize && SessionCipher::readId(message) == 0
+			&& message[8] == static_cast<uint8_t>(MessageType::UnknownSession);
+	}
+
+	std::string SessionEncryptionStrategy::respondToHello(std::span<const uint8_t> message)
+	{
+		using namespace CryptoPP;
+
+		if (message.size() != controlHeaderSize + publicKeySize + timestampSize + macSize)
+		{
+			reportCompromised();
+			return controlMessage(MessageType::Rejected);
+		}
+
+		std::span<const uint8_t> clientPublicKey = message.subspan(controlHeaderSize, publicKeySize);
+		std::span<const uint8_t> clientMac = message.subspan(controlHeaderSize + publicKeySize + timestampSize, macSize);
+		int64_t timestamp = static_cast<int64_t>(SessionCipher::readId(message.subspan(controlHeaderSize + publicKeySize, timestampSize)));
+
+		SessionCipher::Key expectedMac = mac("EasyIPC hello", message.subspan(controlHeaderSize, publicKeySize + timestampSize));
+		if (!VerifyBufsEqual(expectedMac.data(), clientMac.data(), macSize))
+		{
+			reportCompromised();
+			return controlMessage(MessageType::Rejected);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sessionMutex);
+
+			int64_t current = now();
+			int64_t maxAge = std::chrono::duration_cast<std::chrono::milliseconds>(maxHelloAge).count();
+
+			while (!recentHellos.empty() && recentHellos.begin()->first < current - maxAge)
+			{
+				recentHellos.erase(recentHellos.begin());
+			}
+
+			std::array<uint8_t, publicKeySize> key{};
+			std::copy(clientPublicKey.begin(), clientPublicKey.end(), key.begin());
+
+			// too old to still be in recentHellos, or seen already: somebody recorded it
+			if (timestamp < current - maxAge || timestamp > current + maxAge || !recentHellos.emplace(timestamp, key).second)
+			{
+				reportCompromised();
+				return controlMessage(MessageType::Rejected);
+			}
+		}
+
+		AutoSeededRandomPool rng;
+		x25519 keyExchange;
+
+		std::array<uint8_t, x25519::SECRET_KEYLENGTH> privateKey{};
+		std::array<uint8_t, publicKeySize> publicKey{};
+		keyExchange.GenerateKeyPair(rng, privateKey.data(), publicKey.data());
+
+		std::array<uint8_t, x25519::SHARED_KEYLENGTH> sharedSecret{};
+		if (!keyExchange.Agree(sharedSecret.data(), privateKey.data(), clientPublicKey.data()))
+		{
+			reportCompromised();
+			return controlMessage(MessageType::Rejected);
+		}
+
+		auto [clientToServer, serverToClient] = deriveSessionKeys(sharedSecret.data(), preSharedKey, clientPublicKey, publicKey);
+
+		uint64_t sessionId{};
+		std::shared_ptr<SessionCipher> cipher;
+
+		{
+			std::lock_guard<std::mutex> lock(sessionMutex);
+
+			// 0 means no session
+			do
+			{
+				rng.GenerateBlock(reinterpret_cast<uint8_t*>(&sessionId), sizeof(sessionId));
+			} while (sessionId == 0 || sessions.contains(sessionId));
+
+			// bound sessions belong to connected clients, only the ones nobody claimed yet make room
+			if (unboundByAge.size() >= maxUnboundSessions)
+			{
+				auto oldest = unboundByAge.begin();
+				sessions.erase(oldest->second);
+				unboundByAge.erase(oldest);
+			}
+
+			cipher = std::make_shared<SessionCipher>(sessionId, serverToClient, 0, clientToServer, 0, rekeyPolicy, replayWindowSize, [this] { reportCompromised(); });
+
+			uint64_t age = sessionCount++;
+			sessions[sessionId] = { cipher, age, false };
+			unboundByAge[age] = sessionId;
+		}
+
+		std::string welcome;
+		appendId(welcome, 0);
+		welcome.push_back(static_cast<char>(MessageType::Welcome));
+		append(welcome, publicKey);
+		appendId(welcome, sessionId);
+
+		std::string transcript;
+		append(transcript, clientPublicKey);
+		append(transcript, publicKey);
+		appendId(transcript, sessionId);
+		append(welcome, mac("EasyIPC welcome", asBytes(transcript)));
+
+		// the client needs the key of our broadcasts too, only it can decrypt this
+		auto [broadcastKey, broadcastEpoch] = broadcastCipher->getSendKey();
+
+		std::string plainBroadcastKey(1, static_cast<char>(broadcastEpoch));
+		append(plainBroadcastKey, broadcastKey);
+
+		welcome += cipher->encrypt(plainBroadcastKey);
+
+		return welcome;
+	}
+
+	std::string SessionEncryptionStrategy::controlMessage(MessageType type)
+	{
+		std::string message;
+		appendId(message, 0);
+		message.push_back(static_cast<char>(type));
+		return message;
+	}
+
+	SessionCipher::Key SessionEncryptionStrategy::mac(const std::string& label, std::span<const uint8_t> data)
+	{
+		using namespace CryptoPP;
+
+		SessionCipher::Key digest{};
+
+		HMAC<SHA256> hmac(preSharedKey.data(), preSharedKey.size());
+		hmac.Update(reinterpret_cast<const byte*>(label.data()), label.size());
+		hmac.Update(data.data(), data.size());
+		hmac.Final(digest.data());
+
+		return digest;
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "InPlaceEncryptionStrategy.h"
+#include "SessionCipher.h"
+
+#include <map>
+#include <set>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+namespace EasyIPC
+{
+	/*
+	Instead of encrypting everything with the same static key, every client agrees on its own session keys
+	with the server when it connects. The handshake is an X25519 key exchange, authenticated with the
+	pre-shared key, so only processes that know the key can take part and nobody can get in between.
+	The pre-shared key itself never encrypts any messages.
+
+	The server also hands every client the key of its broadcasts (emit()), since those are sent to all clients at once.
+
+	All keys are replaced after RekeyPolicy messages or bytes, without interrupting the traffic, see SessionCipher.
+
+	Set it on both server and client, exactly like the other strategies:
+
+	auto strategy = std::make_shared<EasyIPC::SessionEncryptionStrategy>(preSharedKeyHex);
+	server.setEncryptionStrategy(strategy);
+
+	Messages that fail to authenticate, replays and handshakes with the wrong pre-shared key invoke the compromised callback.
+	*/
+	class SessionEncryptionStrategy : public InPlaceEncryptionStrategy
+	{
+	public:
+
+		// Any length works for the pre-shared key, 32 random bytes (hex encoded) is a good choice
+		// The replay window applies to every session, see ReplayWindow::defaultSize
+		SessionEncryptionStrategy(const std::string& preSharedHexKey, RekeyPolicy rekeyPolicy = {}, uint64_t replayWindowSize = ReplayWindow::defaultSize);
+
+		// Used by the server for its broadcasts
+		size_t headroom() const override;
+		size_t tailroom() const override;
+		void seal(std::span<uint8_t> buffer, std::span<const uint8_t> associatedData) override;
+		std::span<uint8_t> open(std::span<uint8_t> message, std::span<const uint8_t> associatedData) override;
+
+		// What a client uses for one connection
+		struct Session
+		{
+			// requests, responses and events emitted to only this client
+			std::shared_ptr<SessionCipher> direct;
+
+			// events the server emitted to all clients
+			std::shared_ptr<SessionCipher> broadcast;
+		};
+
+		// Client side: runs the handshake. exchange has to send its argument to the server and return the response.
+		// Throws if the server doesnt accept us or the response isnt authentic.
+		Session handshake(const std::function<std::string(const std::string&)>& exchange);
+
+		// Server side: the session a received message belongs to, nullptr for handshakes and unknown sessions
+		std::shared_ptr<SessionCipher> findSession(std::span<const uint8_t> message);
+
+		// Server side: what to send back for a message without session, see findSession.
+		// Either the answer to a handshake or telling the client its session is unknown, e.g. because the server restarted.
+		std::string respond(std::span<const uint8_t> message);
+
+		// Server side: what to send back when even respond() failed, the client then knows its handshake didnt work
+		std::string reject();
+
+		// Server side: the client of the session introduced itself on the direct socket,
+		// from now on the session only ends with endSession() and new handshakes cant push it out anymore
+		void bindSession(uint64_t id);
+
+		// Server side: forget the session once its client is gone
+		void endSession(uint64_t id);
+
+		// Client side: whether the server told us it doesnt know our session (anymore), we have to handshake again
+		static bool isUnknownSession(std::span<const uint8_t> message);
+
+	private:
+
+		// Messages without session start with 8 zero bytes (session id 0) followed by one of these
+		enum class MessageType : uint8_t
+		{
+			Hello = 1,
+			Welcome = 2,
+			Rejected = 3,
+			UnknownSession = 4
+		};
+
+		// Sessions that did the handshake but whose client never showed up on the direct socket are dropped, oldest first
+		static constexpr size_t maxUnboundSessions = 4096;
+
+		// A hello older than this (or this far in the future) is rejected, recent ones are remembered so they cant be replayed
+		static constexpr std::chrono::seconds maxHelloAge{ 60 };
+
+		std::string respondToHello(std::span<const uint8_t> message);
+		std::string controlMessage(MessageType type);
+
+		SessionCipher::Key mac(const std::string& label, std::span<const uint8_t> data);
+
+		std::vector<uint8_t> preSharedKey;
+		RekeyPolicy rekeyPolicy;
+		uint64_t replayWindowSize;
+
+		// for the broadcasts of a server, clients never use it
+		std::shared_ptr<SessionCipher> broadcastCipher;
+
+		struct SessionEntry
+		{
+			std::shared_ptr<SessionCipher> cipher;
+			uint64_t age;
+			bool bound;
+		};
+
+		std::unordered_map<uint64_t, SessionEntry> sessions;
+
+		// ids of the sessions that arent bound yet by when they were created, oldest first
+		std::map<uint64_t, uint64_t> unboundByAge;
+		uint64_t sessionCount;
+
+		// timestamp and client public key of the hellos within maxHelloAge, oldest first. A replay has the same of both.
+		std::set<std::pair<int64_t, std::array<uint8_t, 32>>> recentHellos;
+
+		std::mutex sessionMutex;
+	};
+}
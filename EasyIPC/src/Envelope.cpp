@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "Envelope.h"
+
+#include <limits>
+#include <ostream>
+#include <streambuf>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		constexpr size_t eventSizeSize = 2;
+		constexpr size_t sequenceSize = 8;
+		constexpr size_t kindSize = 1;
+		constexpr size_t metadataSizeSize = 4;
+
+		template<typename Integer>
+		void appendLittleEndian(std::string& out, Integer value, size_t size)
+		{
+			for (size_t i = 0; i < size; ++i)
+			{
+				out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+			}
+		}
+
+		// Appends everything written to it to buffer, so operator<< serializes json right into it
+		class AppendBuffer : public std::streambuf
+		{
+		public:
+			explicit AppendBuffer(std::string& buffer) :
+				buffer{ buffer }
+			{
+
+			}
+
+		protected:
+			int_type overflow(int_type character) override
+			{
+				if (!traits_type::eq_int_type(character, traits_type::eof()))
+				{
+					buffer.push_back(traits_type::to_char_type(character));
+				}
+
+				return traits_type::not_eof(character);
+			}
+
+			std::streamsize xsputn(const char* data, std::streamsize size) override
+			{
+				buffer.append(data, static_cast<size_t>(size));
+				return size;
+			}
+
+		private:
+			std::string& buffer;
+		};
+
+		struct ThreadWriter
+		{
+			std::string buffer;
+
+			// dump() would return a string of its own that then has to be copied over, this writes into buffer.
+			// operator<< still allocates its output adapter and indentation string, but those are small and dont grow with the json.
+			AppendBuffer appendBuffer{ buffer };
+			std::ostream stream{ &appendBuffer };
+		};
+
+		ThreadWriter& threadWriter()
+		{
+			thread_local ThreadWriter writer;
+			return writer;
+		}
+
+		// Starts the envelope in the buffer of this thread, the data goes right behind it
+		ThreadWriter& beginEnvelope(std::string_view event, uint64_t sequence, EnvelopeKind kind)
+		{
+			if (event.size() > std::numeric_limits<uint16_t>::max())
+			{
+				throw std::invalid_argument{ "Event name too long" };
+			}
+
+			ThreadWriter& writer = threadWriter();
+			writer.buffer.clear();
+
+			appendLittleEndian(writer.buffer, event.size(), eventSizeSize);
+			writer.buffer.append(event);
+			appendLittleEndian(writer.buffer, sequence, sequenceSize);
+			writer.buffer.push_back(static_cast<char>(kind));
+			return writer;
+		}
+
+		uint64_t readLittleEndian(std::string_view bytes, size_t size)
+		{
+			uint64_t value = 0;
+			for (size_t i = 0; i < size; ++i)
+			{
+				value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+			}
+
+			return value;
+		}
+	}
+
+	nlohmann::json Envelope::parseData() const
+	{
+		return data.empty() ? nlohmann::json{} : nlohmann::json::parse(data);
+	}
+
+	nlohmann::json readResponse(std::string_view plainText)
+	{
+		if (plainText == acknowledgement)
+		{
+			static const nlohmann::json success = {
+				{"event", "__response__"},
+				{"data", {
+					{"status", "success"}
+				}}
+			};
+
+			return success;
+		}
+
+		return nlohmann::json::parse(plainText);
+	}
+
+	std::string writeEnvelope(std::string_view event, const nlohmann::json& data, uint64_t sequence, EnvelopeKind kind)
+	{
+		return std::string{ writeEnvelopeToThreadBuffer(event, data, sequence, kind) };
+	}
+
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, const nlohmann::json& data, uint64_t sequence, EnvelopeKind kind)
+	{
+		ThreadWriter& writer = beginEnvelope(event, sequence, kind);
+
+		// serialized straight behind the header, instead of into a string of its own that is then copied over
+		if (!data.is_null())
+		{
+			writer.stream << data;
+		}
+
+		return writer.buffer;
+	}
+
+	std::string writeEnvelope(std::string_view event, std::span<const std::byte> data, uint64_t sequence, EnvelopeKind kind)
+	{
+		return std::string{ writeEnvelopeToThreadBuffer(event, data, sequence, kind) };
+	}
+
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, std::span<const std::byte> data, uint64_t sequence, EnvelopeKind kind)
+	{
+		ThreadWriter& writer = beginEnvelope(event, sequence, kind);
+		writer.buffer.append(reinterpret_cast<const char*>(data.data()), data.size());
+		return writer.buffer;
+	}
+
+	std::string writeEnvelope(std::string_view event, const AttachedData& data, uint64_t sequence, EnvelopeKind kind)
+	{
+		return std::string{ writeEnvelopeToThreadBuffer(event, data, sequence, kind) };
+	}
+
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, const AttachedData& data, uint64_t sequence, EnvelopeKind kind)
+	{
+		ThreadWriter& writer = beginEnvelope(event, sequence, kind);
+		size_t dataStart = writer.buffer.size();
+
+		// the size of the metadata is only known once its serialized, so it is filled in afterwards
+		writer.buffer.append(metadataSizeSize, '\0');
+		if (!data.metadata.is_null())
+		{
+			writer.stream << data.metadata;
+		}
+
+		size_t metadataSize = writer.buffer.size() - dataStart - metadataSizeSize;
+		if (metadataSize > std::numeric_limits<uint32_t>::max())
+		{
+			throw std::invalid_argument{ "Metadata too large" };
+		}
+
+		for (size_t i = 0; i < metadataSizeSize; ++i)
+		{
+			writer.buffer[dataStart + i] = static_cast<char>(metadataSize >> (8 * i));
+		}
+
+		appendAttachments(writer.buffer, data.bodyOffset, data.attachments);
+		return writer.buffer;
+	}
+
+	std::string_view dumpToThreadBuffer(const nlohmann::json& json)
+	{
+		ThreadWriter& writer = threadWriter();
+		writer.buffer.clear();
+		writer.stream << json;
+		return writer.buffer;
+	}
+
+	Envelope readEnvelope(std::string_view plainText)
+	{
+		if (plainText.size() < eventSizeSize)
+		{
+			throw std::runtime_error{ "Message too short" };
+		}
+
+		size_t eventSize = readLittleEndian(plainText, eventSizeSize);
+		size_t headerSize = eventSizeSize + eventSize + sequenceSize + kindSize;
+		if (plainText.size() < headerSize)
+		{
+			throw std::runtime_error{ "Message too short" };
+		}
+
+		auto kind = static_cast<EnvelopeKind>(plainText[headerSize - kindSize]);
+		if (kind != EnvelopeKind::Value && kind != EnvelopeKind::Keyframe && kind != EnvelopeKind::Delta)
+		{
+			throw std::runtime_error{ "Unknown kind of message" };
+		}
+
+		Envelope envelope{};
+		envelope.event = plainText.substr(eventSizeSize, eventSize);
+		envelope.sequence = readLittleEndian(plainText.substr(eventSizeSize + eventSize), sequenceSize);
+		envelope.kind = kind;
+		envelope.data = plainText.substr(headerSize);
+		return envelope;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+#include "Attachment.h"
+
+namespace EasyIPC
+{
+	/*
+	The plaintext of every event, a small fixed header followed by the data:
+
+	event size (2, little endian) | event | sequence (8, little endian, 0 if not numbered) | kind (1) | data as json (empty for null) or raw bytes
+
+	The receiver reads the event name without touching the data, so events nobody handles are never parsed,
+	and the data is parsed straight into the json the handler gets. Raw data (emitRaw/onRaw) isnt json at all,
+	which one it is is up to the event, just like its protection.
+	*/
+
+	// What the data of an envelope is, see Server::setDeltaEncoding
+	enum class EnvelopeKind : uint8_t
+	{
+		// The value itself, most events
+		Value = 0,
+
+		// The whole value of a delta encoded event, the following deltas apply to it
+		Keyframe = 1,
+
+		// A JSON Patch against the value of the same event with the sequence right before this one
+		Delta = 2
+	};
+
+	struct Envelope
+	{
+		// All of these point into the plaintext
+		std::string_view event;
+		uint64_t sequence;
+		EnvelopeKind kind;
+		std::string_view data;
+
+		// Parses the data, null if there is none
+		nlohmann::json parseData() const;
+
+		// The data as it is, for raw events
+		std::span<const std::byte> rawData() const { return std::as_bytes(std::span{ data }); }
+	};
+
+	// A new string, for envelopes that have to be kept around, e.g. the records of a batch
+	std::string writeEnvelope(std::string_view event, const nlohmann::json& data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+
+	// Same, but written into a buffer of the calling thread that keeps its capacity, so once it has grown to the largest
+	// message the buffer doesnt allocate anymore. Serializing json still costs two small allocations per write, nlohmann's
+	// operator<< sets up an output adapter and an indentation string every time (see the envelope rows of EasyIPCBench).
+	// The view is only valid until the next write on the same thread, seal it right away.
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, const nlohmann::json& data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+
+	// Raw bytes instead of json, both ways
+	std::string writeEnvelope(std::string_view event, std::span<const std::byte> data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, std::span<const std::byte> data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+
+	// Json metadata with attachments, raw data as far as the envelope is concerned, see Attachment.h
+	std::string writeEnvelope(std::string_view event, const AttachedData& data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+	std::string_view writeEnvelopeToThreadBuffer(std::string_view event, const AttachedData& data, uint64_t sequence = 0, EnvelopeKind kind = EnvelopeKind::Value);
+
+	// json.dump() into the same buffer as writeEnvelopeToThreadBuffer, with the same rules
+	std::string_view dumpToThreadBuffer(const nlohmann::json& json);
+
+	// Throws if the plaintext is too short for its header or of an unknown kind
+	Envelope readEnvelope(std::string_view plainText);
+
+	// Responses are plain json, except when the handler didnt return anything: then the response is this constant,
+	// which is empty and only costs the sealing. Json is never empty, so the client recognizes it without parsing.
+	constexpr std::string_view acknowledgement{};
+
+	// The json of a response, {"event": "__response__", "data": {"status": "success"}} for the acknowledgement
+	nlohmann::json readResponse(std::string_view plainText);
+}
@@ -0,0 +1,294 @@
+#include "pch.h"
+#include "Framing.h"
+#include "Encryption/InPlaceEncryptionStrategy.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		int strength(Protection protection)
+		{
+			switch (protection)
+			{
+				case Protection::Encrypt:
+					return 2;
+				case Protection::Authenticate:
+					return 1;
+				case Protection::Plaintext:
+				default:
+					return 0;
+			}
+		}
+
+		constexpr size_t batchRecordHeaderSize = 4;
+
+		std::string_view asView(std::span<const uint8_t> bytes)
+		{
+			return { reinterpret_cast<const char*>(bytes.data()), bytes.size() };
+		}
+	}
+
+	namespace
+	{
+		// Builds the message around plaintext of the given size, write fills in the plaintext wherever it has to go
+		template<typename Write>
+		NngMessage sealFrame(EncryptionStrategy* strategy, Protection protection, uint8_t flags, size_t plainSize, Write&& write)
+		{
+			auto* inPlaceStrategy = dynamic_cast<InPlaceEncryptionStrategy*>(strategy);
+
+			if (!strategy)
+			{
+				protection = Protection::Plaintext;
+			}
+			else if (protection == Protection::Authenticate && !inPlaceStrategy)
+			{
+				protection = Protection::Encrypt;
+			}
+
+			uint8_t header = static_cast<uint8_t>(protection) | flags;
+
+			if (protection == Protection::Encrypt && !inPlaceStrategy)
+			{
+				// the strategy only knows strings, so this costs a few copies
+				std::string plainText(plainSize, '\0');
+				write(reinterpret_cast<uint8_t*>(plainText.data()));
+				std::string cipherText = strategy->encrypt(plainText);
+
+				NngMessage message = NngMessage::allocate(1 + cipherText.size());
+				message.body()[0] = header;
+				std::memcpy(message.body().data() + 1, cipherText.data(), cipherText.size());
+				return message;
+			}
+
+			size_t overhead = inPlaceStrategy ? inPlaceStrategy->headroom() + inPlaceStrategy->tailroom() : 0;
+
+			switch (protection)
+			{
+				case Protection::Encrypt:
+				{
+					NngMessage message = NngMessage::allocate(1 + overhead + plainSize);
+					std::span<uint8_t> body = message.body();
+
+					body[0] = header;
+					write(body.data() + 1 + inPlaceStrategy->headroom());
+
+					inPlaceStrategy->seal(body.subspan(1), body.first(1));
+					return message;
+				}
+
+				case Protection::Authenticate:
+				{
+					NngMessage message = NngMessage::allocate(1 + plainSize + overhead);
+					std::span<uint8_t> body = message.body();
+
+					body[0] = header;
+					write(body.data() + 1);
+
+					size_t authenticated = 1 + plainSize;
+					inPlaceStrategy->seal(body.subspan(authenticated), body.first(authenticated));
+					return message;
+				}
+
+				case Protection::Plaintext:
+				default:
+				{
+					NngMessage message = NngMessage::allocate(1 + plainSize);
+					std::span<uint8_t> body = message.body();
+
+					body[0] = static_cast<uint8_t>(Protection::Plaintext) | flags;
+					write(body.data() + 1);
+					return message;
+				}
+			}
+		}
+	}
+
+	NngMessage sealEvent(EncryptionStrategy* strategy, Protection protection, std::string_view plainText)
+	{
+		return sealFrame(strategy, protection, 0, plainText.size(), [plainText](uint8_t* destination)
+		{
+			std::memcpy(destination, plainText.data(), plainText.size());
+		});
+	}
+
+	size_t plainTextOffset(EncryptionStrategy* strategy, Protection protection)
+	{
+		auto* inPlaceStrategy = dynamic_cast<InPlaceEncryptionStrategy*>(strategy);
+
+		// same decisions as sealFrame()
+		if (!strategy || protection == Protection::Plaintext || (protection == Protection::Authenticate && inPlaceStrategy))
+			return 1;
+
+		return inPlaceStrategy ? 1 + inPlaceStrategy->headroom() : 0;
+	}
+
+	NngMessage sealBatch(EncryptionStrategy* strategy, Protection protection, std::span<const std::string> records)
+	{
+		size_t plainSize = 0;
+		for (const std::string& record : records)
+		{
+			if (record.size() > UINT32_MAX)
+			{
+				throw std::invalid_argument{ "Record too large for a batch" };
+			}
+
+			plainSize += batchRecordHeaderSize + record.size();
+		}
+
+		return sealFrame(strategy, protection, batchFlag, plainSize, [records](uint8_t* destination)
+		{
+			for (const std::string& record : records)
+			{
+				uint32_t size = static_cast<uint32_t>(record.size());
+				for (size_t i = 0; i < batchRecordHeaderSize; ++i)
+				{
+					*destination++ = static_cast<uint8_t>(size >> (8 * i));
+				}
+
+				std::memcpy(destination, record.data(), record.size());
+				destination += record.size();
+			}
+		});
+	}
+
+	std::vector<std::string_view> splitBatch(std::string_view plainText)
+	{
+		std::vector<std::string_view> records;
+
+		while (!plainText.empty())
+		{
+			if (plainText.size() < batchRecordHeaderSize)
+			{
+				throw std::runtime_error{ "Truncated batch record" };
+			}
+
+			uint32_t size = 0;
+			for (size_t i = 0; i < batchRecordHeaderSize; ++i)
+			{
+				size |= static_cast<uint32_t>(static_cast<uint8_t>(plainText[i])) << (8 * i);
+			}
+
+			plainText.remove_prefix(batchRecordHeaderSize);
+			if (plainText.size() < size)
+			{
+				throw std::runtime_error{ "Truncated batch record" };
+			}
+
+			records.push_back(plainText.substr(0, size));
+			plainText.remove_prefix(size);
+		}
+
+		return records;
+	}
+
+	OpenedEvent openEvent(EncryptionStrategy* strategy, NngMessage& message, std::string& fallback)
+	{
+		std::span<uint8_t> body = message.body();
+
+		if (body.empty())
+		{
+			throw std::runtime_error{ "Empty message" };
+		}
+
+		auto protection = static_cast<Protection>(body[0] & ~batchFlag);
+		bool isBatch = (body[0] & batchFlag) != 0;
+		auto* inPlaceStrategy = dynamic_cast<InPlaceEncryptionStrategy*>(strategy);
+
+		switch (protection)
+		{
+			case Protection::Plaintext:
+				return { protection, isBatch, asView(body.subspan(1)) };
+
+			case Protection::Encrypt:
+			{
+				if (!strategy)
+				{
+					throw std::runtime_error{ "Received an encrypted message, but no encryption strategy is set" };
+				}
+
+				if (!inPlaceStrategy)
+				{
+					fallback = strategy->decrypt(std::string(asView(body.subspan(1))));
+					return { protection, isBatch, fallback };
+				}
+
+				return { protection, isBatch, asView(inPlaceStrategy->open(body.subspan(1), body.first(1))) };
+			}
+
+			case Protection::Authenticate:
+			{
+				if (!inPlaceStrategy)
+				{
+					throw std::runtime_error{ "Received an authenticated message, but the encryption strategy cant verify it" };
+				}
+
+				size_t overhead = inPlaceStrategy->headroom() + inPlaceStrategy->tailroom();
+				if (body.size() < 1 + overhead)
+				{
+					inPlaceStrategy->reportCompromised();
+					throw std::runtime_error{ "Invalid size" };
+				}
+
+				size_t authenticated = body.size() - overhead;
+				inPlaceStrategy->open(body.subspan(authenticated), body.first(authenticated));
+
+				return { protection, isBatch, asView(body.subspan(1, authenticated - 1)) };
+			}
+
+			default:
+			{
+				if (strategy)
+				{
+					strategy->reportCompromised();
+				}
+
+				throw std::runtime_error{ "Unknown protection " + std::to_string(body[0]) };
+			}
+		}
+	}
+
+	std::span<const uint8_t> sealedPart(EncryptionStrategy* strategy, NngMessage& message)
+	{
+		std::span<uint8_t> body = message.body();
+		auto* inPlaceStrategy = dynamic_cast<InPlaceEncryptionStrategy*>(strategy);
+
+		if (body.empty())
+			return {};
+
+		switch (static_cast<Protection>(body[0] & ~batchFlag))
+		{
+			case Protection::Encrypt:
+				return body.subspan(1);
+
+			case Protection::Authenticate:
+			{
+				size_t overhead = inPlaceStrategy ? inPlaceStrategy->headroom() + inPlaceStrategy->tailroom() : 0;
+				return body.size() >= 1 + overhead ? body.last(overhead) : std::span<uint8_t>{};
+			}
+
+			default:
+				return {};
+		}
+	}
+
+	bool isProtectedEnough(Protection actual, Protection expected)
+	{
+		return strength(actual) >= strength(expected);
+	}
+
+	Protection strongerProtection(Protection first, Protection second)
+	{
+		return strength(first) >= strength(second) ? first : second;
+	}
+
+	NngMessage rawMessage(std::string_view bytes)
+	{
+		NngMessage message = NngMessage::allocate(bytes.size());
+		std::memcpy(message.body().data(), bytes.data(), bytes.size());
+		return message;
+	}
+}
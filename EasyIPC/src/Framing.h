@@ -0,0 +1,67 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "NngMessage.h"
+#include "Protection.h"
+#include "Encryption/EncryptionStrategy.h"
+
+namespace EasyIPC
+{
+	/*
+	Every event message starts with its Protection, followed by:
+
+	Encrypt:      whatever the strategy makes of the plaintext, the protection byte is authenticated too
+	Authenticate: the plaintext, then an empty plaintext sealed by the strategy with everything before it as associated data
+	Plaintext:    the plaintext
+
+	Strategies that only implement the string based interface cant authenticate without encrypting,
+	with those Authenticate turns into Encrypt. Without a strategy everything is Plaintext.
+
+	A batch has batchFlag set in the first byte, its plaintext are the records one after another,
+	each prefixed with its size (4 bytes, little endian). The whole batch gets one nonce and one tag.
+	*/
+
+	constexpr uint8_t batchFlag = 0x80;
+
+	// Puts the plaintext into a new message, leaving room for whatever the strategy adds, and encrypts or authenticates it in place.
+	NngMessage sealEvent(EncryptionStrategy* strategy, Protection protection, std::string_view plainText);
+
+	// Where sealEvent() puts the plaintext in the body of the message, and where the receiver finds it after opening it.
+	// 0 if it is decrypted into a fallback string instead.
+	size_t plainTextOffset(EncryptionStrategy* strategy, Protection protection);
+
+	// Seals several records as one message, see splitBatch
+	NngMessage sealBatch(EncryptionStrategy* strategy, Protection protection, std::span<const std::string> records);
+
+	struct OpenedEvent
+	{
+		Protection protection;
+		bool isBatch;
+
+		// lives inside the message (or the fallback string)
+		std::string_view plainText;
+	};
+
+	// Decrypts or verifies the message in place. Strategies that only implement the string based interface decrypt into fallback instead.
+	// Throws if the message isnt authentic.
+	OpenedEvent openEvent(EncryptionStrategy* strategy, NngMessage& message, std::string& fallback);
+
+	// The records of an opened batch, they live wherever the plaintext lives. Throws if the sizes dont add up.
+	std::vector<std::string_view> splitBatch(std::string_view plainText);
+
+	// The part of an event message the strategy produced, e.g. to find out which session it belongs to. Empty for plaintext.
+	std::span<const uint8_t> sealedPart(EncryptionStrategy* strategy, NngMessage& message);
+
+	// Whether an event that arrived with one protection is protected at least as well as expected
+	bool isProtectedEnough(Protection actual, Protection expected);
+
+	// Whichever of the two protects more, e.g. for a batch of events with different protections
+	Protection strongerProtection(Protection first, Protection second);
+
+	// A message exactly as given, e.g. for handshakes
+	NngMessage rawMessage(std::string_view bytes);
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "MessageArena.h"
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <algorithm>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		constexpr size_t initialArenaSize = 16 * 1024;
+
+		// One huge message shouldnt keep that much memory alive on every thread forever
+		constexpr size_t maxRetainedArenaSize = 4 * 1024 * 1024;
+
+		// Takes what doesnt fit into the buffer of the arena from the heap and remembers how much that was and where it is
+		class OverflowResource : public std::pmr::memory_resource
+		{
+		public:
+			size_t allocated = 0;
+
+			// the few large blocks the arena asked for, until the scope ends
+			std::vector<std::pair<const std::byte*, size_t>> blocks;
+
+		private:
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				void* block = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+				blocks.emplace_back(static_cast<const std::byte*>(block), bytes);
+				allocated += bytes;
+				return block;
+			}
+
+			void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+			{
+				std::erase_if(blocks, [pointer](const auto& block) { return block.first == pointer; });
+				std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+			}
+
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+			{
+				return this == &other;
+			}
+		};
+
+		struct ThreadArena
+		{
+			std::unique_ptr<std::byte[]> buffer;
+			size_t bufferSize = 0;
+			OverflowResource overflow;
+
+			// Only set while a scope is active
+			std::optional<std::pmr::monotonic_buffer_resource> resource;
+		};
+
+		ThreadArena& threadArena()
+		{
+			thread_local ThreadArena arena;
+			return arena;
+		}
+
+		bool contains(const std::byte* begin, size_t size, const std::byte* pointer)
+		{
+			return std::less_equal<>{}(begin, pointer) && std::less<>{}(pointer, begin + size);
+		}
+	}
+
+	std::pmr::memory_resource* MessageArena::current()
+	{
+		ThreadArena& arena = threadArena();
+
+		if (arena.resource)
+		{
+			return &*arena.resource;
+		}
+
+		return std::pmr::new_delete_resource();
+	}
+
+	void MessageArena::deallocate(void* pointer, size_t bytes, size_t alignment) noexcept
+	{
+		ThreadArena& arena = threadArena();
+		const std::byte* address = static_cast<const std::byte*>(pointer);
+
+		if (arena.buffer && contains(arena.buffer.get(), arena.bufferSize, address))
+			return;
+
+		for (const auto& [block, size] : arena.overflow.blocks)
+		{
+			if (contains(block, size, address))
+				return;
+		}
+
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	}
+
+	MessageArena::Scope::Scope()
+	{
+		ThreadArena& arena = threadArena();
+
+		outermost = !arena.resource;
+		if (!outermost)
+			return;
+
+		if (!arena.buffer)
+		{
+			arena.buffer = std::make_unique_for_overwrite<std::byte[]>(initialArenaSize);
+			arena.bufferSize = initialArenaSize;
+		}
+
+		arena.overflow.allocated = 0;
+		arena.resource.emplace(arena.buffer.get(), arena.bufferSize, &arena.overflow);
+	}
+
+	MessageArena::Scope::~Scope()
+	{
+		if (!outermost)
+			return;
+
+		ThreadArena& arena = threadArena();
+
+		// hands the overflow back to the heap, the buffer itself is simply reused by the next scope
+		arena.resource.reset();
+
+		// the message didnt fit, so make room for it next time
+		if (arena.overflow.allocated > 0 && arena.bufferSize < maxRetainedArenaSize)
+		{
+			size_t grownSize = std::min(arena.bufferSize + arena.overflow.allocated, maxRetainedArenaSize);
+			arena.buffer = std::make_unique_for_overwrite<std::byte[]>(grownSize);
+			arena.bufferSize = grownSize;
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <nlohmann/json.hpp>
+
+namespace EasyIPC
+{
+	/*
+	Every thread that handles events keeps one arena. While a handler attached with onArena() runs, everything its
+	ArenaJson allocates comes from that arena and is released at once after the handler returned, instead of one free per node.
+	The arena keeps its memory between messages and grows to the largest message it has seen, so once warmed up
+	parsing doesnt touch the heap at all.
+	*/
+	class MessageArena
+	{
+	public:
+		// Where ArenaAllocator allocates on this thread: the arena while a message is being handled, otherwise the heap
+		static std::pmr::memory_resource* current();
+
+		// Gives memory of an ArenaAllocator back where it came from, no matter which resource is current now:
+		// nothing happens for memory of the arena of this thread (it is released at once), everything else goes back to the heap
+		static void deallocate(void* pointer, size_t bytes, size_t alignment) noexcept;
+
+		// Makes the arena of this thread the current resource until it is destroyed, then releases everything allocated from it.
+		// Nested scopes share the outer one.
+		class Scope
+		{
+		public:
+			Scope();
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			bool outermost;
+		};
+	};
+
+	// Keeps the resource that was current when it was created, like std::pmr::polymorphic_allocator,
+	// so strings and containers keep allocating where they started even when they are changed outside of the handler.
+	// nlohmann creates a new allocator for every node it allocates or frees, so deallocate() never relies on the resource
+	// and all of them can free each others memory.
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		ArenaAllocator() noexcept :
+			resource{ MessageArena::current() }
+		{
+
+		}
+
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) noexcept :
+			resource{ other.getResource() }
+		{
+
+		}
+
+		T* allocate(size_t count)
+		{
+			return static_cast<T*>(resource->allocate(count * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T* pointer, size_t count) noexcept
+		{
+			MessageArena::deallocate(pointer, count * sizeof(T), alignof(T));
+		}
+
+		// a copy allocates wherever new json would, e.g. copying a kept value in a handler doesnt end up on the heap
+		ArenaAllocator select_on_container_copy_construction() const noexcept { return {}; }
+
+		std::pmr::memory_resource* getResource() const noexcept { return resource; }
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+
+	private:
+		std::pmr::memory_resource* resource;
+	};
+
+	using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+	// A nlohmann::json whose nodes and strings live in the arena of the message it was parsed from.
+	// It has the same interface as nlohmann::json, but it must not outlive the handler it was passed to:
+	// to keep (parts of) it, convert to a nlohmann::json first, e.g. nlohmann::json kept = data["items"];
+	// An ArenaJson made outside of a handler can be read and freed inside one, but new values added to it there end up in the arena too.
+	using ArenaJson = nlohmann::basic_json<std::map, std::vector, ArenaString, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
+}
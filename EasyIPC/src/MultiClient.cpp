@@ -0,0 +1,460 @@
+#include "pch.h"
+#include "MultiClient.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		constexpr int virtualNodesPerConnection = 64;
+
+		// FNV-1a, unlike std::hash its the same in every process, so separate client processes route the same way
+		uint64_t hashString(const std::string& value)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (unsigned char character : value)
+			{
+				hash ^= character;
+				hash *= 1099511628211ull;
+			}
+
+			return hash;
+		}
+	}
+
+	MultiClient::MultiClient(RoutingPolicy policy) :
+		policy{ policy },
+		requestTimeoutMS{ -1 },
+		nextConnection{ 0 }
+	{
+
+	}
+
+	MultiClient::~MultiClient()
+	{
+		shutdown();
+	}
+
+	void MultiClient::connect(const std::vector<Endpoint>& endpoints, int maxRetries, int retryDelayMS, const ConnectionConfig& config)
+	{
+		std::vector<std::shared_ptr<Connection>> connected;
+
+		for (const Endpoint& endpoint : endpoints)
+		{
+			auto connection = std::make_shared<Connection>();
+			connection->endpoint = endpoint;
+			connection->client = std::make_unique<Client>();
+			connection->client->setEncryptionStrategy(encryptionStrategy);
+			connection->client->setRequestTimeout(requestTimeoutMS);
+
+			{
+				std::lock_guard<std::mutex> lock(connectionMutex);
+				for (const auto& [event, priority] : eventPriorities)
+				{
+					connection->client->setEventPriority(event, priority);
+				}
+
+				for (const auto& [event, protection] : eventProtections)
+				{
+					connection->client->setEventProtection(event, protection);
+				}
+
+				for (const auto& [event, eventHandler] : eventHandlers)
+				{
+					if (eventHandler.rawHandler)
+					{
+						connection->client->onRaw(event, eventHandler.rawHandler);
+					}
+					else if (eventHandler.arenaHandler)
+					{
+						connection->client->onArena(event, eventHandler.arenaHandler);
+					}
+					else if (eventHandler.viewHandler)
+					{
+						connection->client->onView(event, eventHandler.viewHandler);
+					}
+					else
+					{
+						connection->client->on(event, eventHandler.handler);
+					}
+				}
+			}
+
+			try
+			{
+				connection->client->connect(endpoint.url, endpoint.port, maxRetries, retryDelayMS, config);
+				connected.push_back(connection);
+			}
+			catch (const std::exception& exception)
+			{
+				std::cerr << "[EasyIPC::MultiClient::connect] Leaving out " << endpoint.url << ":" << endpoint.port << ": " << exception.what() << "\n";
+			}
+		}
+
+		if (connected.empty())
+		{
+			throw std::runtime_error{ "[EasyIPC::MultiClient::connect] Failed to connect to any of the servers." };
+		}
+
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		connections.insert(connections.end(), connected.begin(), connected.end());
+		rebuildRoutes();
+	}
+
+	bool MultiClient::isConnected()
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		return !connections.empty();
+	}
+
+	void MultiClient::shutdown()
+	{
+		std::vector<std::shared_ptr<Connection>> closing;
+
+		{
+			std::lock_guard<std::mutex> lock(connectionMutex);
+			closing.swap(connections);
+			healthyConnections.clear();
+			hashRing.clear();
+		}
+
+		for (const auto& connection : closing)
+		{
+			connection->client->shutdown();
+		}
+	}
+
+	void MultiClient::setHashKey(const std::string& payloadKey)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		hashKey = payloadKey;
+	}
+
+	void MultiClient::setRequestTimeout(int timeoutMS)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		requestTimeoutMS = timeoutMS;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->setRequestTimeout(timeoutMS);
+		}
+	}
+
+	void MultiClient::on(const std::string& event, std::function<void(const nlohmann::json&)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventHandlers[event] = { handler, nullptr, nullptr, nullptr };
+
+		// kept for servers that are connected later
+		if (priority)
+			eventPriorities[event] = *priority;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->on(event, handler, priority);
+		}
+	}
+
+	void MultiClient::onView(const std::string& event, std::function<void(const DataView&)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventHandlers[event] = { nullptr, handler, nullptr, nullptr };
+
+		// kept for servers that are connected later
+		if (priority)
+			eventPriorities[event] = *priority;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->onView(event, handler, priority);
+		}
+	}
+
+	void MultiClient::onArena(const std::string& event, std::function<void(const ArenaJson&)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventHandlers[event] = { nullptr, nullptr, handler, nullptr };
+
+		// kept for servers that are connected later
+		if (priority)
+			eventPriorities[event] = *priority;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->onArena(event, handler, priority);
+		}
+	}
+
+	void MultiClient::onRaw(const std::string& event, std::function<void(std::span<const std::byte>)> handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventHandlers[event] = { nullptr, nullptr, nullptr, handler };
+
+		// kept for servers that are connected later
+		if (priority)
+			eventPriorities[event] = *priority;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->onRaw(event, handler, priority);
+		}
+	}
+
+	void MultiClient::setEventPriority(const std::string& event, Priority priority)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventPriorities[event] = priority;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->setEventPriority(event, priority);
+		}
+	}
+
+	void MultiClient::setEventProtection(const std::string& event, Protection protection)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		eventProtections[event] = protection;
+
+		for (const auto& connection : connections)
+		{
+			connection->client->setEventProtection(event, protection);
+		}
+	}
+
+	template<typename Send>
+	auto MultiClient::sendVia(const std::shared_ptr<Connection>& connection, const char* method, Send&& send)
+	{
+		++connection->outstanding;
+
+		try
+		{
+			auto response = send(*connection->client);
+			--connection->outstanding;
+
+			// it was left out before and answered its first emit since
+			if (connection->failures > 0)
+			{
+				markHealthy(connection);
+			}
+
+			return response;
+		}
+		catch (const TransportError& exception)
+		{
+			--connection->outstanding;
+
+			std::cerr << "[EasyIPC::MultiClient::" << method << "] Leaving out " << connection->endpoint.url << ":" << connection->endpoint.port
+				<< " for a while after failed emit: " << exception.what() << "\n";
+
+			markUnhealthy(connection);
+			throw;
+		}
+		catch (...)
+		{
+			// the server is there, the emit just didnt work out (e.g. the handler failed or the session has to be renegotiated)
+			--connection->outstanding;
+			throw;
+		}
+	}
+
+	nlohmann::json MultiClient::emit(const std::string& event, const nlohmann::json& data)
+	{
+		std::shared_ptr<Connection> connection = pickConnection(event, data);
+
+		return sendVia(connection, "emit", [&](Client& client) { return client.emit(event, data); });
+	}
+
+	nlohmann::json MultiClient::emitRaw(const std::string& event, std::span<const std::byte> data)
+	{
+		// the bytes cant be looked into, so consistent hashing goes by the event name
+		std::shared_ptr<Connection> connection = pickConnection(event, nullptr);
+
+		return sendVia(connection, "emitRaw", [&](Client& client) { return client.emitRaw(event, data); });
+	}
+
+	nlohmann::json MultiClient::emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments)
+	{
+		std::shared_ptr<Connection> connection = pickConnection(event, metadata);
+
+		return sendVia(connection, "emitAttachments", [&](Client& client) { return client.emitAttachments(event, metadata, attachments); });
+	}
+
+	std::vector<nlohmann::json> MultiClient::emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events)
+	{
+		if (events.empty())
+			return {};
+
+		// the whole batch goes to one server, routed like its first event
+		std::shared_ptr<Connection> connection = pickConnection(events.front().first, events.front().second);
+
+		return sendVia(connection, "emitBatch", [&](Client& client) { return client.emitBatch(events); });
+	}
+
+	std::vector<Endpoint> MultiClient::getEndpoints()
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+
+		reviveConnections();
+
+		std::vector<Endpoint> endpoints;
+		endpoints.reserve(healthyConnections.size());
+
+		for (const auto& connection : healthyConnections)
+		{
+			endpoints.push_back(connection->endpoint);
+		}
+
+		return endpoints;
+	}
+
+	void MultiClient::setOnCompromisedCallback(const std::function<void()>& callback)
+	{
+		// all connections share the same strategy instance, so setting it once covers all of them
+		if (encryptionStrategy)
+		{
+			encryptionStrategy->setOnCompromisedHandler(callback);
+		}
+	}
+
+	void MultiClient::setEncryptionStrategy(std::shared_ptr<EncryptionStrategy> strategy)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		encryptionStrategy = std::move(strategy);
+
+		for (const auto& connection : connections)
+		{
+			connection->client->setEncryptionStrategy(encryptionStrategy);
+		}
+	}
+
+	std::shared_ptr<MultiClient::Connection> MultiClient::pickConnection(const std::string& event, const nlohmann::json& data)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+
+		if (connections.empty())
+		{
+			throw std::runtime_error{ "[EasyIPC::MultiClient::emit] Not connected to any server. Cant emit." };
+		}
+
+		reviveConnections();
+
+		if (healthyConnections.empty())
+		{
+			throw TransportError{ "[EasyIPC::MultiClient::emit] None of the servers can be reached right now. Cant emit." };
+		}
+
+		switch (policy)
+		{
+			case RoutingPolicy::LeastOutstanding:
+			{
+				auto least = std::min_element(healthyConnections.begin(), healthyConnections.end(), [](const auto& a, const auto& b)
+				{
+					return a->outstanding < b->outstanding;
+				});
+
+				return *least;
+			}
+
+			case RoutingPolicy::ConsistentHash:
+			{
+				std::string key = event;
+
+				if (!hashKey.empty() && data.is_object() && data.contains(hashKey))
+				{
+					const nlohmann::json& value = data[hashKey];
+					key = value.is_string() ? value.get<std::string>() : value.dump();
+				}
+
+				// first virtual node clockwise from the key, wrapping around at the end of the ring
+				auto node = hashRing.lower_bound(hashString(key));
+				if (node == hashRing.end())
+				{
+					node = hashRing.begin();
+				}
+
+				return node->second;
+			}
+
+			case RoutingPolicy::RoundRobin:
+			default:
+			{
+				return healthyConnections[nextConnection++ % healthyConnections.size()];
+			}
+		}
+	}
+
+	void MultiClient::markUnhealthy(const std::shared_ptr<Connection>& connection)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+
+		// another emit that failed on the same server could have left it out already, or we shut down in the meantime
+		if (connection->unhealthy || std::find(connections.begin(), connections.end(), connection) == connections.end())
+			return;
+
+		// the client keeps reconnecting on its own, we only wait longer the more often it failed
+		int failures = ++connection->failures;
+		auto delay = initialRetryDelay * (1 << std::min(failures - 1, 16));
+
+		connection->unhealthy = true;
+		connection->retryAt = std::chrono::steady_clock::now() + std::min<std::chrono::milliseconds>(delay, maxRetryDelay);
+		rebuildRoutes();
+	}
+
+	void MultiClient::markHealthy(const std::shared_ptr<Connection>& connection)
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+
+		connection->failures = 0;
+
+		if (connection->unhealthy && std::find(connections.begin(), connections.end(), connection) != connections.end())
+		{
+			connection->unhealthy = false;
+			rebuildRoutes();
+		}
+	}
+
+	void MultiClient::reviveConnections()
+	{
+		auto now = std::chrono::steady_clock::now();
+		bool revived = false;
+
+		for (const auto& connection : connections)
+		{
+			if (connection->unhealthy && connection->retryAt <= now)
+			{
+				connection->unhealthy = false;
+				revived = true;
+			}
+		}
+
+		if (revived)
+		{
+			rebuildRoutes();
+		}
+	}
+
+	void MultiClient::rebuildRoutes()
+	{
+		healthyConnections.clear();
+		hashRing.clear();
+
+		for (const auto& connection : connections)
+		{
+			if (connection->unhealthy)
+				continue;
+
+			healthyConnections.push_back(connection);
+
+			std::string name = connection->endpoint.url + ":" + std::to_string(connection->endpoint.port);
+
+			for (int node = 0; node < virtualNodesPerConnection; ++node)
+			{
+				hashRing[hashString(name + "#" + std::to_string(node))] = connection;
+			}
+		}
+	}
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <nlohmann/json.hpp>
+
+#include "Client.h"
+#include "Encryption/EncryptionStrategy.h"
+
+namespace EasyIPC
+{
+	struct Endpoint
+	{
+		std::string url;
+		uint16_t port;
+	};
+
+	// How MultiClient::emit picks the server an event is sent to
+	enum class RoutingPolicy
+	{
+		// Take turns, every server gets the same share of events
+		RoundRobin,
+
+		// Send to the server with the fewest emits that are still waiting for their response
+		LeastOutstanding,
+
+		// The same event name (or the same value of the hash key, see setHashKey) always goes to the same server,
+		// as long as that server is alive. Losing a server only moves the events that were routed to it.
+		ConsistentHash
+	};
+
+	/*
+	A client that is connected to several identical servers at once and spreads its emits across them.
+	Events emitted by any of the servers reach the handlers attached with .on().
+
+	EasyIPC::MultiClient client{ EasyIPC::RoutingPolicy::LeastOutstanding };
+	client.setRequestTimeout(2000);
+	client.connect({ {"tcp://localhost", 57239}, {"tcp://localhost", 57339} });
+
+	nlohmann::json response = client.emit("work", {{"id", 1}});
+
+	If a server cant be reached (the request couldnt be sent or the response didnt arrive within the request timeout)
+	it is left out of the routing for a while and the TransportError is rethrown, so you can decide whether its safe
+	to emit the event again. Following emits are routed to the remaining servers, and once the while is over the server
+	gets the next emit routed to it again. The while doubles every time the server fails again, up to maxRetryDelay.
+	Any other exception (e.g. the handler on the server failed) is rethrown without touching the server.
+	*/
+	class MultiClient
+	{
+	public:
+		MultiClient(RoutingPolicy policy = RoutingPolicy::RoundRobin);
+		~MultiClient();
+
+		// Connects to every endpoint, endpoints that cant be reached are left out.
+		// Throws if none of them could be reached.
+		void connect(const std::vector<Endpoint>& endpoints, int maxRetries = 5, int retryDelayMS = 1000, const ConnectionConfig& config = {});
+		bool isConnected();
+
+		void shutdown();
+
+		// Only used by RoutingPolicy::ConsistentHash: hash the value of this property of the emitted data
+		// instead of the event name. Events without that property still fall back to the event name.
+		void setHashKey(const std::string& payloadKey);
+
+		// Without a timeout a server that died in the middle of an emit would block forever, instead of being left out.
+		// See Client::setRequestTimeout
+		void setRequestTimeout(int timeoutMS);
+
+		// Same as Client::on, the handler is attached to the connections to all servers
+		void on(const std::string& event, std::function<void(const nlohmann::json&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as Client::onView, the handler is attached to the connections to all servers
+		void onView(const std::string& event, std::function<void(const DataView&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as Client::onArena, the handler is attached to the connections to all servers
+		void onArena(const std::string& event, std::function<void(const ArenaJson&)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as Client::onRaw, the handler is attached to the connections to all servers
+		void onRaw(const std::string& event, std::function<void(std::span<const std::byte>)> handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as Client::onFixed, the handler is attached to the connections to all servers
+		template<FixedLayout T>
+		void onFixed(const std::string& event, std::function<void(const T&)> handler, std::optional<Priority> priority = std::nullopt)
+		{
+			onRaw(event, [handler](std::span<const std::byte> bytes) { handler(readFixed<T>(bytes)); }, priority);
+		}
+
+		// Same as Client::onAttachments, the handler is attached to the connections to all servers
+		template<typename HandlerType>
+		void onAttachments(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt)
+		{
+			onRaw(event, readingAttachments(std::move(handler)), priority);
+		}
+
+		// See Client::setEventPriority
+		void setEventPriority(const std::string& event, Priority priority);
+
+		// See Client::setEventProtection
+		void setEventProtection(const std::string& event, Protection protection);
+
+		// Same as Client::emit, but to one of the servers picked by the routing policy
+		nlohmann::json emit(const std::string& event, const nlohmann::json& data = {});
+
+		// Same as Client::emitRaw, routed like an emit() without data
+		nlohmann::json emitRaw(const std::string& event, std::span<const std::byte> data);
+
+		// Same as Client::emitFixed, routed like emitRaw()
+		template<FixedLayout T>
+		nlohmann::json emitFixed(const std::string& event, const T& value) { return emitRaw(event, writeFixed(value)); }
+
+		// Same as Client::emitAttachments, routed like an emit() of the metadata
+		nlohmann::json emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments);
+
+		// Same as Client::emitBatch, the whole batch goes to the server the first event would be routed to
+		std::vector<nlohmann::json> emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events);
+
+		// Endpoints that are currently used for routing, servers that cant be reached right now are left out
+		std::vector<Endpoint> getEndpoints();
+
+		void setOnCompromisedCallback(const std::function<void()>& callback);
+		void setEncryptionStrategy(std::shared_ptr<EncryptionStrategy> strategy);
+
+	private:
+
+		// How long a server that couldnt be reached is left out at first, and at most
+		static constexpr std::chrono::milliseconds initialRetryDelay{ 500 };
+		static constexpr std::chrono::milliseconds maxRetryDelay{ 30000 };
+
+		struct Connection
+		{
+			Endpoint endpoint;
+			std::unique_ptr<Client> client;
+			std::atomic<int> outstanding{ 0 };
+
+			// Transport failures in a row, 0 while the server is healthy
+			std::atomic<int> failures{ 0 };
+
+			// Guarded by connectionMutex: whether it is left out of the routing, and until when
+			bool unhealthy = false;
+			std::chrono::steady_clock::time_point retryAt;
+		};
+
+		std::shared_ptr<Connection> pickConnection(const std::string& event, const nlohmann::json& data);
+
+		// Runs send(client) while the connection counts it as outstanding. A connection whose send fails with a TransportError
+		// is left out for a while, see markUnhealthy. method names the caller in the log.
+		template<typename Send>
+		auto sendVia(const std::shared_ptr<Connection>& connection, const char* method, Send&& send);
+		void markUnhealthy(const std::shared_ptr<Connection>& connection);
+		void markHealthy(const std::shared_ptr<Connection>& connection);
+
+		// Puts connections whose retryAt is over back into the routing, needs connectionMutex
+		void reviveConnections();
+
+		// Rebuilds healthyConnections and the hash ring from connections, needs connectionMutex
+		void rebuildRoutes();
+
+		RoutingPolicy policy;
+		std::string hashKey;
+		int requestTimeoutMS;
+
+		// Every server we are connected to, healthy or not
+		std::vector<std::shared_ptr<Connection>> connections;
+
+		// The ones emits are routed to
+		std::vector<std::shared_ptr<Connection>> healthyConnections;
+
+		// Every connection is placed on the ring multiple times so the keys are spread evenly
+		std::map<uint64_t, std::shared_ptr<Connection>> hashRing;
+		size_t nextConnection;
+		std::mutex connectionMutex;
+
+		std::shared_ptr<EncryptionStrategy> encryptionStrategy;
+
+		struct EventHandler
+		{
+			std::function<void(const nlohmann::json&)> handler;
+			std::function<void(const DataView&)> viewHandler;
+			std::function<void(const ArenaJson&)> arenaHandler;
+			std::function<void(std::span<const std::byte>)> rawHandler;
+		};
+
+		std::unordered_map<std::string, EventHandler> eventHandlers;
+		std::unordered_map<std::string, Priority> eventPriorities;
+		std::unordered_map<std::string, Protection> eventProtections;
+	};
+}
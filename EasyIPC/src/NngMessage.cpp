@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "NngMessage.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace EasyIPC
+{
+	NngMessage::~NngMessage()
+	{
+		free();
+	}
+
+	NngMessage::NngMessage() :
+		message{ nullptr }
+	{
+
+	}
+
+	NngMessage::NngMessage(nng_msg* message) :
+		message{ message }
+	{
+
+	}
+
+	NngMessage::NngMessage(NngMessage&& other) noexcept :
+		message{ other.message }
+	{
+		other.message = nullptr;
+	}
+
+	NngMessage& NngMessage::operator=(NngMessage&& other) noexcept
+	{
+		if (this != &other)
+		{
+			free();
+			message = other.message;
+			other.message = nullptr;
+		}
+
+		return *this;
+	}
+
+	NngMessage NngMessage::allocate(size_t size)
+	{
+		nng_msg* message = nullptr;
+
+		int returnValue = nng_msg_alloc(&message, size);
+		if (returnValue != 0)
+		{
+			throw std::runtime_error{ "Failed to allocate message: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		return NngMessage{ message };
+	}
+
+	NngMessage NngMessage::duplicate() const
+	{
+		nng_msg* copy = nullptr;
+
+		int returnValue = nng_msg_dup(&copy, message);
+		if (returnValue != 0)
+		{
+			throw std::runtime_error{ "Failed to duplicate message: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		return NngMessage{ copy };
+	}
+
+	std::span<uint8_t> NngMessage::body()
+	{
+		if (!message)
+			return {};
+
+		return { static_cast<uint8_t*>(nng_msg_body(message)), nng_msg_len(message) };
+	}
+
+	int NngMessage::send(nng_socket socket, int flags)
+	{
+		int returnValue = nng_sendmsg(socket, message, flags);
+		if (returnValue == 0)
+		{
+			message = nullptr;
+		}
+
+		return returnValue;
+	}
+
+	int NngMessage::receive(nng_socket socket, int flags)
+	{
+		free();
+		return nng_recvmsg(socket, &message, flags);
+	}
+
+	int NngMessage::send(nng_ctx context, int flags)
+	{
+		int returnValue = nng_ctx_sendmsg(context, message, flags);
+		if (returnValue == 0)
+		{
+			message = nullptr;
+		}
+
+		return returnValue;
+	}
+
+	int NngMessage::receive(nng_ctx context, int flags)
+	{
+		free();
+		return nng_ctx_recvmsg(context, &message, flags);
+	}
+
+	void NngMessage::free()
+	{
+		if (message)
+		{
+			nng_msg_free(message);
+			message = nullptr;
+		}
+	}
+}
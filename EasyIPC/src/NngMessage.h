@@ -0,0 +1,48 @@
+#pragma once
+#include <nng/nng.h>
+
+#include <span>
+#include <cstdint>
+
+namespace EasyIPC
+{
+	// Owns a nng_msg, frees it unless it was handed over to nng by a successful send
+	class NngMessage
+	{
+	public:
+		~NngMessage();
+
+		NngMessage();
+		explicit NngMessage(nng_msg* message);
+		NngMessage(NngMessage&& other) noexcept;
+
+		NngMessage& operator=(NngMessage&& other) noexcept;
+
+		NngMessage(const NngMessage& other) = delete;
+		NngMessage& operator=(const NngMessage& other) = delete;
+
+		// Allocates a message with a body of the given size, throws if nng is out of memory
+		static NngMessage allocate(size_t size);
+
+		nng_msg* get() const { return message; }
+		explicit operator bool() const { return message != nullptr; }
+
+		std::span<uint8_t> body();
+
+		// A copy of the message (nng_msg_dup), e.g. to send the same one several times. Throws if nng is out of memory.
+		NngMessage duplicate() const;
+
+		// On success nng owns the message and this one is empty, on failure the message is still ours
+		int send(nng_socket socket, int flags = 0);
+		int send(nng_ctx context, int flags = 0);
+
+		// Replaces the current message with the received one
+		int receive(nng_socket socket, int flags = 0);
+		int receive(nng_ctx context, int flags = 0);
+
+		void free();
+
+	private:
+		nng_msg* message;
+	};
+}
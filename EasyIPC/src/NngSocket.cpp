@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "NngSocket.h"
 
+#include <stdexcept>
+#include <string>
+
 namespace EasyIPC
 {
 	NngSocket::~NngSocket()
@@ -55,5 +58,31 @@ namespace EasyIPC
 			isOpen = false;
 		}
 	}
-}
 
+	void NngSocket::applyConfig(const ConnectionConfig& config)
+	{
+		auto check = [](int returnValue, const char* option)
+		{
+			// e.g. SUB sockets dont send, so they dont have a send buffer
+			if (returnValue != 0 && returnValue != NNG_ENOTSUP)
+			{
+				throw std::runtime_error{ std::string("Failed to set ") + option + ": " + nng_strerror(returnValue) };
+			}
+		};
+
+		if (config.sendBufferDepth > 0)
+		{
+			check(nng_socket_set_int(socket, NNG_OPT_SENDBUF, config.sendBufferDepth), NNG_OPT_SENDBUF);
+		}
+
+		if (config.receiveBufferDepth > 0)
+		{
+			check(nng_socket_set_int(socket, NNG_OPT_RECVBUF, config.receiveBufferDepth), NNG_OPT_RECVBUF);
+		}
+
+		if (config.maxMessageSize > 0)
+		{
+			check(nng_socket_set_size(socket, NNG_OPT_RECVMAXSZ, config.maxMessageSize), NNG_OPT_RECVMAXSZ);
+		}
+	}
+}
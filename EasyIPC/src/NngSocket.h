@@ -1,6 +1,8 @@
 #pragma once
 #include <nng/nng.h>
 
+#include "ConnectionConfig.h"
+
 
 namespace EasyIPC
 {
@@ -25,6 +27,9 @@ namespace EasyIPC
 		void markOpen();
 		void close();
 
+		// Applies the queue depths and the maximum message size, options the protocol doesnt have are skipped
+		void applyConfig(const ConnectionConfig& config);
+
 	private:
 		nng_socket socket;
 		bool isOpen;
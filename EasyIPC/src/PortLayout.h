@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Priority.h"
+
+namespace EasyIPC
+{
+	// A server occupies a small block of consecutive ports starting at the port passed to serve()/connect().
+	// Keep the offsets in one place so the server, the client and anything built on top of them agree on the layout.
+	namespace PortOffset
+	{
+		// server PUB -> client SUB, events emitted to all clients
+		constexpr uint16_t Publish = 0;
+
+		// client REQ -> server REP, events emitted by a client and the servers response
+		constexpr uint16_t Request = 1;
+
+		// server PAIR (polyamorous) <-> client PAIR, events emitted to one specific client
+		constexpr uint16_t Direct = 2;
+
+		// Same as Publish and Request, but for events with Priority::Control
+		constexpr uint16_t ControlPublish = 3;
+		constexpr uint16_t ControlRequest = 4;
+
+		inline uint16_t publish(Priority priority)
+		{
+			return priority == Priority::Control ? ControlPublish : Publish;
+		}
+
+		inline uint16_t request(Priority priority)
+		{
+			return priority == Priority::Control ? ControlRequest : Request;
+		}
+	}
+
+	inline std::string makeSocketUrl(const std::string& url, uint16_t port, uint16_t offset)
+	{
+		return url + ":" + std::to_string(port + offset);
+	}
+}
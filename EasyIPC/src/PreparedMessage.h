@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "Priority.h"
+#include "Protection.h"
+
+namespace EasyIPC
+{
+	class NngMessage;
+
+	/*
+	An event that is emitted over and over with the same data, e.g. a heartbeat or a config snapshot.
+	Build it once with Server::prepare() and pass it to Server::emit() as often as you like:
+
+	EasyIPC::PreparedMessage ping = server.prepare("ping");
+	while (running)
+	{
+		server.emit(ping);
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	The data is serialized once. Plaintext events (and every event while the server has no encryption strategy) are kept as
+	finished nng messages that are only duplicated when emitted, everything else is still sealed on every emit,
+	since every message needs a fresh nonce (and with that a fresh ciphertext and tag).
+	Copies of a PreparedMessage share all of that.
+	It uses the priority and protection its event had when it was prepared, and unlike emit() it isnt numbered,
+	so clients dont track it for lost messages.
+	*/
+	class PreparedMessage
+	{
+	public:
+		const std::string& getEvent() const { return event; }
+
+	private:
+		friend class Server;
+
+		// Only Server::prepare() makes them, an empty one couldnt be emitted
+		PreparedMessage() = default;
+
+		std::string event;
+		Priority priority{};
+		Protection protection{};
+
+		// The envelope, serialized once, shared with the crypto workers instead of copied for them
+		std::shared_ptr<const std::string> plainText;
+
+		// The finished message if it doesnt have to be sealed, nullptr otherwise
+		std::shared_ptr<const NngMessage> message;
+	};
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace EasyIPC
+{
+	// Every priority has its own sockets, and with that its own connections and receive threads.
+	// A large message of a lower priority therefore never delays a message of a higher priority,
+	// neither while being sent nor while its handler is running.
+	enum class Priority
+	{
+		// Default for all events
+		Normal,
+
+		// Small, urgent events like heartbeats or kill switches
+		Control
+	};
+
+	constexpr size_t priorityCount = 2;
+}
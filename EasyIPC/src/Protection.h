@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace EasyIPC
+{
+	// How an event is protected when an encryption strategy is set. Every message says how it was protected,
+	// and the receiver rejects messages that are protected less than it expects for their event,
+	// so nobody can slip in a plaintext message for an event that is supposed to be encrypted.
+	// Authenticate needs a strategy that derives from InPlaceEncryptionStrategy, with any other strategy it encrypts instead.
+	// Plaintext stays plaintext with every strategy, and without a strategy everything is sent as plaintext.
+	enum class Protection : uint8_t
+	{
+		// Default for all events: nobody can read or change it
+		Encrypt = 1,
+
+		// Everybody can read it, but nobody can change it without the receiver noticing
+		Authenticate = 2,
+
+		// For harmless high rate events like ticks and telemetry, no cryptography at all
+		Plaintext = 3
+	};
+}
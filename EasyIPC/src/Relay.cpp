@@ -0,0 +1,448 @@
+#include "pch.h"
+#include "Relay.h"
+
+#include <vector>
+#include <iostream>
+
+#include "NngSocket.h"
+#include "NngMessage.h"
+#include "PortLayout.h"
+
+#include <nng/protocol/pubsub0/pub.h>
+#include <nng/protocol/pubsub0/sub.h>
+#include <nng/protocol/reqrep0/req.h>
+#include <nng/protocol/reqrep0/rep.h>
+#include <nng/protocol/pair1/pair.h>
+
+namespace EasyIPC
+{
+	namespace
+	{
+		// How often the direct thread wakes up to close the server connections of clients that disconnected,
+		// and to pass on messages of clients whose connection to the server just came up
+		constexpr int directReceiveTimeoutMS = 250;
+
+		// How many messages of one client are held while its connection to the server is being set up, newer ones are dropped
+		constexpr size_t maxPendingMessages = 64;
+	}
+
+	struct Relay::DirectPeer
+	{
+		Relay* relay = nullptr;
+		nng_pipe downstreamPipe = NNG_PIPE_INITIALIZER;
+		NngSocket upstreamSocket;
+		nng_aio* receive = nullptr;
+
+		// Set by nng once the connection to the server is up, until then the messages of the client wait in pending.
+		// pending is only touched by the direct thread.
+		std::atomic<bool> upstreamConnected{ false };
+		std::vector<NngMessage> pending;
+
+		~DirectPeer()
+		{
+			// closing first makes a pending receive complete with NNG_ECLOSED, so the callback doesnt start another one
+			upstreamSocket.close();
+
+			if (receive)
+			{
+				nng_aio_stop(receive);
+				nng_aio_free(receive);
+			}
+		}
+	};
+
+	struct DirectForwarding
+	{
+		static void onDownstreamPipeEvent(nng_pipe pipe, nng_pipe_ev event, void* argument)
+		{
+			Relay* relay = static_cast<Relay*>(argument);
+			uint32_t pipeId = static_cast<uint32_t>(nng_pipe_id(pipe));
+
+			std::lock_guard<std::mutex> lock(relay->directMutex);
+
+			if (event == NNG_PIPE_EV_ADD_POST)
+			{
+				relay->connectedDirectPipes.insert(pipeId);
+			}
+			else
+			{
+				relay->connectedDirectPipes.erase(pipeId);
+				relay->directPipesRemoved = true;
+			}
+		}
+
+		// We are not allowed to use the socket from in here, so only flag it, the direct thread sends what is pending
+		static void onUpstreamPipeAdded(nng_pipe, nng_pipe_ev, void* argument)
+		{
+			static_cast<Relay::DirectPeer*>(argument)->upstreamConnected = true;
+		}
+
+		// The server went away (e.g. restarted), so drop the client too. It reconnects to us and introduces itself again,
+		// which gets it a new connection to the server.
+		static void onUpstreamPipeRemoved(nng_pipe, nng_pipe_ev, void* argument)
+		{
+			nng_pipe_close(static_cast<Relay::DirectPeer*>(argument)->downstreamPipe);
+		}
+
+		// Runs on a nng thread whenever the server sent something to the client behind this peer
+		static void onUpstreamMessage(void* argument)
+		{
+			Relay::DirectPeer* peer = static_cast<Relay::DirectPeer*>(argument);
+
+			int returnValue = nng_aio_result(peer->receive);
+			if (returnValue == NNG_ECLOSED || returnValue == NNG_ECANCELED)
+				return;
+
+			if (returnValue == 0)
+			{
+				NngMessage message{ nng_aio_get_msg(peer->receive) };
+
+				// the polyamorous pair socket sends it to exactly this client
+				nng_msg_set_pipe(message.get(), peer->downstreamPipe);
+
+				returnValue = message.send(peer->relay->downstreamDirectSocket->get(), NNG_FLAG_NONBLOCK);
+			}
+
+			if (returnValue != 0 && peer->relay->isRunning)
+			{
+				std::cerr << "[EasyIPC::Relay::forwardDirect] Dropped message to a client: " << nng_strerror(returnValue) << "\n";
+			}
+
+			nng_recv_aio(peer->upstreamSocket.get(), peer->receive);
+		}
+	};
+
+	Relay::Relay() :
+		downstreamDirectSocket{ std::make_unique<NngSocket>() },
+		isRunning{ false }
+	{
+		for (Lane& lane : lanes)
+		{
+			lane.upstreamSubSocket = std::make_unique<NngSocket>();
+			lane.downstreamPubSocket = std::make_unique<NngSocket>();
+			lane.upstreamReqSocket = std::make_unique<NngSocket>();
+			lane.downstreamRepSocket = std::make_unique<NngSocket>();
+		}
+	}
+
+	Relay::~Relay()
+	{
+		shutdown();
+	}
+
+	void Relay::start(const std::string& upstreamUrl, uint16_t upstreamPort, const std::string& listenUrl, uint16_t listenPort, const ConnectionConfig& config)
+	{
+		int returnValue{};
+
+		for (size_t index = 0; index < priorityCount; ++index)
+		{
+			Lane& lane = lanes[index];
+			Priority priority = static_cast<Priority>(index);
+
+			// nng_device only works with raw sockets, raw sockets also dont look at the messages at all.
+			// A raw SUB socket doesnt filter by topic, so no subscribe is needed.
+			if ((returnValue = nng_sub0_open_raw(&lane.upstreamSubSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open raw SUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.upstreamSubSocket->markOpen();
+			lane.upstreamSubSocket->applyConfig(config);
+
+			if ((returnValue = nng_pub0_open_raw(&lane.downstreamPubSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open raw PUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.downstreamPubSocket->markOpen();
+			lane.downstreamPubSocket->applyConfig(config);
+
+			if ((returnValue = nng_req0_open_raw(&lane.upstreamReqSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open raw REQ socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.upstreamReqSocket->markOpen();
+			lane.upstreamReqSocket->applyConfig(config);
+
+			if ((returnValue = nng_rep0_open_raw(&lane.downstreamRepSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open raw REP socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.downstreamRepSocket->markOpen();
+			lane.downstreamRepSocket->applyConfig(config);
+
+			std::string upstreamSubUrl = makeSocketUrl(upstreamUrl, upstreamPort, PortOffset::publish(priority));
+			std::string upstreamReqUrl = makeSocketUrl(upstreamUrl, upstreamPort, PortOffset::request(priority));
+			std::string downstreamPubUrl = makeSocketUrl(listenUrl, listenPort, PortOffset::publish(priority));
+			std::string downstreamRepUrl = makeSocketUrl(listenUrl, listenPort, PortOffset::request(priority));
+
+			if ((returnValue = nng_listen(lane.downstreamPubSocket->get(), downstreamPubUrl.c_str(), nullptr, 0)) != 0)
+			{
+				throw std::runtime_error{ "Failed to listen on PUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			if ((returnValue = nng_listen(lane.downstreamRepSocket->get(), downstreamRepUrl.c_str(), nullptr, 0)) != 0)
+			{
+				throw std::runtime_error{ "Failed to listen on REP socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			// non blocking dial: if the server isnt up (yet) nng keeps redialing in the background
+			if ((returnValue = nng_dial(lane.upstreamSubSocket->get(), upstreamSubUrl.c_str(), nullptr, NNG_FLAG_NONBLOCK)) != 0)
+			{
+				throw std::runtime_error{ "Failed to dial SUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			if ((returnValue = nng_dial(lane.upstreamReqSocket->get(), upstreamReqUrl.c_str(), nullptr, NNG_FLAG_NONBLOCK)) != 0)
+			{
+				throw std::runtime_error{ "Failed to dial REQ socket: " + std::string(nng_strerror(returnValue)) };
+			}
+		}
+
+		if ((returnValue = nng_pair1_open_poly(&downstreamDirectSocket->get())) != 0)
+		{
+			throw std::runtime_error{ "Failed to open PAIR socket: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		downstreamDirectSocket->markOpen();
+		downstreamDirectSocket->applyConfig(config);
+
+		if ((returnValue = nng_pipe_notify(downstreamDirectSocket->get(), NNG_PIPE_EV_ADD_POST, DirectForwarding::onDownstreamPipeEvent, this)) != 0
+			|| (returnValue = nng_pipe_notify(downstreamDirectSocket->get(), NNG_PIPE_EV_REM_POST, DirectForwarding::onDownstreamPipeEvent, this)) != 0)
+		{
+			throw std::runtime_error{ "Failed to set PAIR pipe notification: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		if ((returnValue = nng_socket_set_ms(downstreamDirectSocket->get(), NNG_OPT_RECVTIMEO, directReceiveTimeoutMS)) != 0)
+		{
+			throw std::runtime_error{ "Failed to set PAIR receive timeout: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		upstreamDirectUrl = makeSocketUrl(upstreamUrl, upstreamPort, PortOffset::Direct);
+		this->config = config;
+
+		std::string downstreamDirectUrl = makeSocketUrl(listenUrl, listenPort, PortOffset::Direct);
+
+		if ((returnValue = nng_listen(downstreamDirectSocket->get(), downstreamDirectUrl.c_str(), nullptr, 0)) != 0)
+		{
+			throw std::runtime_error{ "Failed to listen on PAIR socket: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		isRunning = true;
+
+		for (Lane& lane : lanes)
+		{
+			lane.publishThread = std::thread(&Relay::forward, this, std::ref(*lane.upstreamSubSocket), std::ref(*lane.downstreamPubSocket), "events");
+			lane.requestThread = std::thread(&Relay::forward, this, std::ref(*lane.downstreamRepSocket), std::ref(*lane.upstreamReqSocket), "requests");
+		}
+
+		directThread = std::thread(&Relay::forwardDirect, this);
+
+		std::cout << "[EasyIPC::Relay::start] Relaying " << upstreamUrl << ":" << upstreamPort << " to " << listenUrl << ":" << listenPort << "\n";
+	}
+
+	void Relay::shutdown()
+	{
+		std::lock_guard<std::mutex> lock(shutdownMutex);
+
+		if (isRunning)
+		{
+			isRunning = false;
+
+			// closing the sockets makes nng_device return
+			for (Lane& lane : lanes)
+			{
+				lane.upstreamSubSocket->close();
+				lane.downstreamPubSocket->close();
+				lane.upstreamReqSocket->close();
+				lane.downstreamRepSocket->close();
+			}
+
+			downstreamDirectSocket->close();
+
+			for (Lane& lane : lanes)
+			{
+				if (lane.publishThread.joinable())
+				{
+					lane.publishThread.join();
+				}
+
+				if (lane.requestThread.joinable())
+				{
+					lane.requestThread.join();
+				}
+			}
+
+			if (directThread.joinable())
+			{
+				directThread.join();
+			}
+
+			directPeers.clear();
+		}
+	}
+
+	void Relay::forward(NngSocket& from, NngSocket& to, const char* label)
+	{
+		// Blocks until one of the sockets is closed. For REQ/REP this forwards in both directions,
+		// the raw sockets keep the routing headers so responses find their way back to the right client.
+		int returnValue = nng_device(from.get(), to.get());
+
+		if (isRunning)
+		{
+			std::cerr << "[EasyIPC::Relay::forward] Stopped forwarding " << label << ": " << nng_strerror(returnValue) << "\n";
+		}
+	}
+
+	void Relay::forwardDirect()
+	{
+		while (isRunning)
+		{
+			removeDisconnectedPeers();
+
+			for (auto& [pipeId, peer] : directPeers)
+			{
+				sendPending(*peer);
+			}
+
+			NngMessage message;
+			int returnValue = message.receive(downstreamDirectSocket->get());
+
+			if (returnValue == NNG_ECLOSED)
+				break;
+
+			// the timeout only exists so disconnected clients get cleaned up regularly
+			if (returnValue == NNG_ETIMEDOUT)
+				continue;
+
+			if (returnValue != 0)
+			{
+				std::cerr << "[EasyIPC::Relay::forwardDirect] Receive error: " << nng_strerror(returnValue) << "\n";
+				continue;
+			}
+
+			nng_pipe pipe = nng_msg_get_pipe(message.get());
+
+			try
+			{
+				DirectPeer* peer = findOrConnectPeer(static_cast<uint32_t>(nng_pipe_id(pipe)));
+				if (!peer)
+					continue;
+
+				// queued behind whatever is still waiting for the connection, so the order stays the same
+				if (peer->pending.size() >= maxPendingMessages)
+				{
+					std::cerr << "[EasyIPC::Relay::forwardDirect] Dropped message from a client: the server isnt reachable yet\n";
+					continue;
+				}
+
+				peer->pending.push_back(std::move(message));
+				sendPending(*peer);
+			}
+			catch (const std::exception& exception)
+			{
+				std::cerr << "[EasyIPC::Relay::forwardDirect] Exception: " << exception.what() << "\n";
+
+				// the client reconnects and introduces itself again, which gives the server another try
+				nng_pipe_close(pipe);
+			}
+		}
+	}
+
+	Relay::DirectPeer* Relay::findOrConnectPeer(uint32_t pipeId)
+	{
+		auto existing = directPeers.find(pipeId);
+		if (existing != directPeers.end())
+		{
+			return existing->second.get();
+		}
+
+		{
+			// a message that was still queued when its client disconnected, dont open a connection nobody would close
+			std::lock_guard<std::mutex> lock(directMutex);
+			if (!connectedDirectPipes.contains(pipeId))
+				return nullptr;
+		}
+
+		auto peer = std::make_unique<DirectPeer>();
+		peer->relay = this;
+		peer->downstreamPipe.id = pipeId;
+
+		int returnValue{};
+
+		if ((returnValue = nng_pair1_open(&peer->upstreamSocket.get())) != 0)
+		{
+			throw std::runtime_error{ "Failed to open PAIR socket: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		peer->upstreamSocket.markOpen();
+		peer->upstreamSocket.applyConfig(config);
+
+		if ((returnValue = nng_pipe_notify(peer->upstreamSocket.get(), NNG_PIPE_EV_ADD_POST, DirectForwarding::onUpstreamPipeAdded, peer.get())) != 0
+			|| (returnValue = nng_pipe_notify(peer->upstreamSocket.get(), NNG_PIPE_EV_REM_POST, DirectForwarding::onUpstreamPipeRemoved, peer.get())) != 0)
+		{
+			throw std::runtime_error{ "Failed to set PAIR pipe notification: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		// non blocking, a slow or unreachable server must not hold up the direct traffic of all other clients.
+		// The message that made us connect (the hello of the client) waits in pending until the connection is up.
+		if ((returnValue = nng_dial(peer->upstreamSocket.get(), upstreamDirectUrl.c_str(), nullptr, NNG_FLAG_NONBLOCK)) != 0)
+		{
+			throw std::runtime_error{ "Failed to dial PAIR socket: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		if ((returnValue = nng_aio_alloc(&peer->receive, DirectForwarding::onUpstreamMessage, peer.get())) != 0)
+		{
+			throw std::runtime_error{ "Failed to allocate aio: " + std::string(nng_strerror(returnValue)) };
+		}
+
+		nng_recv_aio(peer->upstreamSocket.get(), peer->receive);
+
+		return directPeers.emplace(pipeId, std::move(peer)).first->second.get();
+	}
+
+	void Relay::sendPending(DirectPeer& peer)
+	{
+		if (peer.pending.empty() || !peer.upstreamConnected)
+			return;
+
+		for (NngMessage& message : peer.pending)
+		{
+			int returnValue = message.send(peer.upstreamSocket.get(), NNG_FLAG_NONBLOCK);
+			if (returnValue != 0)
+			{
+				std::cerr << "[EasyIPC::Relay::forwardDirect] Dropped message from a client: " << nng_strerror(returnValue) << "\n";
+			}
+		}
+
+		peer.pending.clear();
+	}
+
+	void Relay::removeDisconnectedPeers()
+	{
+		// destroyed after the lock is released, closing a peer runs pipe callbacks that take the lock themselves
+		std::vector<std::unique_ptr<DirectPeer>> disconnected;
+
+		{
+			std::lock_guard<std::mutex> lock(directMutex);
+
+			if (!directPipesRemoved)
+				return;
+
+			directPipesRemoved = false;
+
+			for (auto peer = directPeers.begin(); peer != directPeers.end();)
+			{
+				if (connectedDirectPipes.contains(peer->first))
+				{
+					++peer;
+					continue;
+				}
+
+				disconnected.push_back(std::move(peer->second));
+				peer = directPeers.erase(peer);
+			}
+		}
+	}
+}
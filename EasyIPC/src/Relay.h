@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ConnectionConfig.h"
+#include "Priority.h"
+
+namespace EasyIPC
+{
+	// Forward declare since users of this lib arent supposed to deal with nanomsg
+	class NngSocket;
+
+	/*
+	Sits between a server and any number of clients and forwards all traffic between them.
+	The relay is the servers only subscriber, so emitting costs the server the same no matter
+	how many clients are attached to the relay (or to relays attached to this relay).
+	A typical setup is one relay per host, with all clients on that host connecting to the local relay.
+
+	Messages are forwarded byte for byte, the relay never decrypts anything and therefore needs no key.
+
+	To clients a relay looks like a server, they simply connect to the relay url and port instead.
+	Every client behind the relay gets its own direct connection to the server, opened when the client introduces itself,
+	so Server::emitTo and SessionEncryptionStrategy work through a relay just like without one.
+	*/
+	class Relay
+	{
+	public:
+		Relay();
+		~Relay();
+
+		// Start forwarding between the server at upstreamUrl:upstreamPort and clients connecting to listenUrl:listenPort.
+		// The server doesnt have to be up yet, the relay keeps trying to connect in the background.
+		// The config applies to the sockets on both sides, see ConnectionConfig.
+		void start(const std::string& upstreamUrl, uint16_t upstreamPort, const std::string& listenUrl, uint16_t listenPort, const ConnectionConfig& config = {});
+
+		// Note: This also gets called in destructor
+		void shutdown();
+
+	private:
+		// Every priority is relayed separately, so the relay keeps control events ahead of large ones
+		struct Lane
+		{
+			// server -> clients, events emitted to all clients
+			std::unique_ptr<NngSocket> upstreamSubSocket;
+			std::unique_ptr<NngSocket> downstreamPubSocket;
+
+			// clients -> server, emitted events and the servers responses
+			std::unique_ptr<NngSocket> upstreamReqSocket;
+			std::unique_ptr<NngSocket> downstreamRepSocket;
+
+			std::thread publishThread;
+			std::thread requestThread;
+		};
+
+		// One client behind the relay and its own connection to the direct socket of the server
+		struct DirectPeer;
+
+		void forward(NngSocket& from, NngSocket& to, const char* label);
+
+		// client -> server on the direct sockets, server -> client is done by the peers as messages arrive
+		void forwardDirect();
+		DirectPeer* findOrConnectPeer(uint32_t pipeId);
+		void removeDisconnectedPeers();
+
+		// Sends what the client sent while the connection of the peer to the server wasnt up yet, in order
+		void sendPending(DirectPeer& peer);
+
+		friend struct DirectForwarding;
+
+		std::array<Lane, priorityCount> lanes;
+		std::unique_ptr<NngSocket> downstreamDirectSocket;
+
+		// Only touched by the direct thread, and by shutdown() once that thread is gone
+		std::unordered_map<uint32_t, std::unique_ptr<DirectPeer>> directPeers;
+
+		// Direct connections of clients that are currently up, maintained by nng pipe notifications
+		std::unordered_set<uint32_t> connectedDirectPipes;
+		bool directPipesRemoved = false;
+		std::mutex directMutex;
+
+		std::thread directThread;
+		std::string upstreamDirectUrl;
+		ConnectionConfig config;
+
+		std::atomic<bool> isRunning;
+
+		std::mutex shutdownMutex;
+	};
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <concepts>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+namespace EasyIPC
+{
+	/*
+	Fixed layout events: for hot events whose fields are known at compile time, send a plain struct instead of json.
+	The struct is copied into the message as it is and read back with a single memcpy, there is nothing to parse.
+
+	struct Tick
+	{
+		double price;
+		uint32_t volume;
+		char symbol[8];
+	};
+	EASYIPC_SCHEMA(Tick, price, volume, symbol)
+
+	server.emitFixed("tick", Tick{ 1.5, 100, "EURUSD" });
+	client.onFixed<Tick>("tick", [](const Tick& tick) { ... });
+
+	EASYIPC_SCHEMA has to be used at global scope and list every field. The name, size, offset and kind of each field
+	go into a fingerprint that travels with every message, so a receiver built with a different layout drops the message
+	instead of reading garbage. Since the bytes are sent as they are, both sides have to run on the same kind of machine
+	(endianness, alignment), which is always the case for processes on the same host.
+	The struct has to be trivially copyable and standard layout, so no std::string or pointers, use fixed size arrays.
+	*/
+	template<typename T>
+	struct Schema;
+
+	template<typename T>
+	concept FixedLayout = std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T> && requires
+	{
+		{ Schema<T>::fingerprint } -> std::convertible_to<uint64_t>;
+	};
+
+	namespace detail
+	{
+		// FNV-1a, constexpr so the fingerprint is computed by the compiler
+		class FingerprintBuilder
+		{
+		public:
+			constexpr FingerprintBuilder(std::string_view typeName, size_t size)
+			{
+				add(typeName);
+				add(size);
+			}
+
+			template<typename Field>
+			constexpr FingerprintBuilder& field(std::string_view name, size_t offset)
+			{
+				using Element = std::remove_all_extents_t<Field>;
+
+				add(name);
+				add(offset);
+				add(sizeof(Field));
+
+				// so a float doesnt silently turn into an int of the same size
+				add(std::is_floating_point_v<Element> ? 1 : std::is_signed_v<Element> ? 2 : 3);
+				return *this;
+			}
+
+			constexpr uint64_t get() const { return hash; }
+
+		private:
+			constexpr void add(std::string_view text)
+			{
+				for (char character : text)
+				{
+					hash ^= static_cast<unsigned char>(character);
+					hash *= 1099511628211ull;
+				}
+
+				// so "ab" + "c" and "a" + "bc" differ
+				hash ^= 0xff;
+				hash *= 1099511628211ull;
+			}
+
+			constexpr void add(uint64_t value)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					hash ^= (value >> (8 * i)) & 0xff;
+					hash *= 1099511628211ull;
+				}
+			}
+
+			uint64_t hash = 14695981039346656037ull;
+		};
+	}
+
+	// What a fixed layout event looks like on the wire: fingerprint (8 bytes) | the struct
+	template<FixedLayout T>
+	constexpr size_t fixedMessageSize = sizeof(uint64_t) + sizeof(T);
+
+	template<FixedLayout T>
+	std::array<std::byte, fixedMessageSize<T>> writeFixed(const T& value)
+	{
+		std::array<std::byte, fixedMessageSize<T>> bytes;
+
+		uint64_t fingerprint = Schema<T>::fingerprint;
+		std::memcpy(bytes.data(), &fingerprint, sizeof(fingerprint));
+		std::memcpy(bytes.data() + sizeof(fingerprint), &value, sizeof(T));
+		return bytes;
+	}
+
+	// Throws if the bytes werent written with the same layout of T
+	template<FixedLayout T>
+	T readFixed(std::span<const std::byte> bytes)
+	{
+		if (bytes.size() != fixedMessageSize<T>)
+		{
+			throw std::runtime_error{ "Fixed layout message has " + std::to_string(bytes.size()) + " bytes, expected " + std::to_string(fixedMessageSize<T>) };
+		}
+
+		uint64_t fingerprint = 0;
+		std::memcpy(&fingerprint, bytes.data(), sizeof(fingerprint));
+		if (fingerprint != Schema<T>::fingerprint)
+		{
+			throw std::runtime_error{ "Fixed layout message was written with a different schema" };
+		}
+
+		// the plaintext sits wherever the framing put it, so its not necessarily aligned for T
+		T value;
+		std::memcpy(&value, bytes.data() + sizeof(fingerprint), sizeof(T));
+		return value;
+	}
+}
+
+// The MSVC preprocessor passes __VA_ARGS__ on as one argument unless it is expanded again
+#define EASYIPC_SCHEMA_EXPAND(x) x
+
+#define EASYIPC_SCHEMA_FIELD(Type, member) .field<decltype(Type::member)>(#member, offsetof(Type, member))
+
+#define EASYIPC_SCHEMA_FIELDS_1(Type, member) EASYIPC_SCHEMA_FIELD(Type, member)
+#define EASYIPC_SCHEMA_FIELDS_2(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_1(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_3(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_2(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_4(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_3(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_5(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_4(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_6(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_5(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_7(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_6(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_8(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_7(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_9(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_8(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_10(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_9(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_11(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_10(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_12(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_11(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_13(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_12(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_14(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_13(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_15(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_14(Type, __VA_ARGS__))
+#define EASYIPC_SCHEMA_FIELDS_16(Type, member, ...) EASYIPC_SCHEMA_FIELD(Type, member) EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_FIELDS_15(Type, __VA_ARGS__))
+
+#define EASYIPC_SCHEMA_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, NAME, ...) NAME
+
+// Declares the fields of a struct for emitFixed()/onFixed(), up to 16 fields, see Schema.h
+#define EASYIPC_SCHEMA(Type, ...) \
+	template<> \
+	struct EasyIPC::Schema<Type> \
+	{ \
+		static constexpr uint64_t fingerprint = EasyIPC::detail::FingerprintBuilder{ #Type, sizeof(Type) } \
+			EASYIPC_SCHEMA_EXPAND(EASYIPC_SCHEMA_PICK(__VA_ARGS__, \
+				EASYIPC_SCHEMA_FIELDS_16, EASYIPC_SCHEMA_FIELDS_15, EASYIPC_SCHEMA_FIELDS_14, EASYIPC_SCHEMA_FIELDS_13, \
+				EASYIPC_SCHEMA_FIELDS_12, EASYIPC_SCHEMA_FIELDS_11, EASYIPC_SCHEMA_FIELDS_10, EASYIPC_SCHEMA_FIELDS_9, \
+				EASYIPC_SCHEMA_FIELDS_8, EASYIPC_SCHEMA_FIELDS_7, EASYIPC_SCHEMA_FIELDS_6, EASYIPC_SCHEMA_FIELDS_5, \
+				EASYIPC_SCHEMA_FIELDS_4, EASYIPC_SCHEMA_FIELDS_3, EASYIPC_SCHEMA_FIELDS_2, EASYIPC_SCHEMA_FIELDS_1)(Type, __VA_ARGS__)) \
+			.get(); \
+	};
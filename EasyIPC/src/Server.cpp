@@ -1,22 +1,128 @@
 #include "pch.h"
 #include "Server.h"
 
+#include <limits>
+#include <ostream>
+#include <algorithm>
 #include <iostream>
+#include <streambuf>
+#include <functional>
 
 #include "NngSocket.h"
+#include "NngMessage.h"
+#include "Framing.h"
+#include "Envelope.h"
+#include "CryptoPool.h"
+#include "PortLayout.h"
+#include "Encryption/SessionEncryptionStrategy.h"
 
 #include <nng/protocol/pubsub0/pub.h>
 #include <nng/protocol/reqrep0/rep.h>
+#include <nng/protocol/pair1/pair.h>
 
 namespace EasyIPC
 {
+	namespace
+	{
+		nlohmann::json errorResponse(const std::string& message)
+		{
+			return {
+				{"event", "__response__"},
+				{"data", {
+					{"status", "error"},
+					{"message", message}
+				}}
+			};
+		}
+
+		struct LimitReached {};
+
+		// Counts what operator<< writes without keeping it, and stops the serializer once there is more than limit
+		class SizeCounter : public std::streambuf
+		{
+		public:
+			explicit SizeCounter(size_t limit) :
+				limit{ limit }
+			{
+
+			}
+
+			size_t size = 0;
+
+		protected:
+			int_type overflow(int_type character) override
+			{
+				count(1);
+				return traits_type::not_eof(character);
+			}
+
+			std::streamsize xsputn(const char*, std::streamsize count) override
+			{
+				this->count(static_cast<size_t>(count));
+				return count;
+			}
+
+		private:
+			void count(size_t bytes)
+			{
+				size += bytes;
+				if (size > limit)
+					throw LimitReached{};
+			}
+
+			size_t limit;
+		};
+
+		// Whether json serializes to more than limit bytes, only serializes as much as it takes to find out
+		bool serializesLargerThan(const nlohmann::json& json, size_t limit)
+		{
+			SizeCounter counter{ limit };
+			std::ostream stream{ &counter };
+
+			// otherwise the stream would swallow LimitReached
+			stream.exceptions(std::ios::badbit);
+
+			try
+			{
+				stream << json;
+			}
+			catch (const LimitReached&)
+			{
+				return true;
+			}
+
+			return false;
+		}
+
+		size_t serializedSize(const nlohmann::json& json)
+		{
+			SizeCounter counter{ std::numeric_limits<size_t>::max() };
+			std::ostream stream{ &counter };
+			stream << json;
+			return counter.size;
+		}
+	}
+
+	struct DirectPipeEvents
+	{
+		// A client disconnected, its id can no longer be emitted to
+		static void onRemoved(nng_pipe pipe, nng_pipe_ev, void* server)
+		{
+			static_cast<Server*>(server)->forgetClient(static_cast<uint32_t>(nng_pipe_id(pipe)));
+		}
+	};
+
 	Server::Server() :
-		pubSocket{ std::make_unique<NngSocket>() },
-		repSocket{ std::make_unique<NngSocket>() },
+		directSocket{ std::make_unique<NngSocket>() },
+		cryptoWorkerCount{ 0 },
 		isRunning{ false },
 		isStarted{ false }
 	{
-
+		for (Lane& lane : lanes)
+		{
+			lane.pubSocket = std::make_unique<NngSocket>();
+			lane.repSocket = std::make_unique<NngSocket>();
+		}
 	}
 
 	Server::~Server()
@@ -24,42 +130,90 @@ namespace EasyIPC
 		shutdown();
 	}
 
-	void Server::serve(const std::string& url, uint16_t port)
+	void Server::serve(const std::string& url, uint16_t port, const ConnectionConfig& config)
 	{
 		int returnValue{};
 
-		if ((returnValue = nng_pub0_open(&pubSocket->get())) != 0)
+		for (Lane& lane : lanes)
+		{
+			if ((returnValue = nng_pub0_open(&lane.pubSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open PUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.pubSocket->markOpen();
+			lane.pubSocket->applyConfig(config);
+
+			if ((returnValue = nng_rep0_open(&lane.repSocket->get())) != 0)
+			{
+				throw std::runtime_error{ "Failed to open REP socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			lane.repSocket->markOpen();
+			lane.repSocket->applyConfig(config);
+		}
+
+		// Polyamorous pair lets us pick the pipe (=client) every single message goes to, see emitTo().
+		// Its deprecated in newer nng versions but there is no replacement with the same semantics yet.
+		if ((returnValue = nng_pair1_open_poly(&directSocket->get())) != 0)
 		{
-			throw std::runtime_error{ "Failed to open PUB socket: " + std::string(nng_strerror(returnValue)) };
+			throw std::runtime_error{ "Failed to open PAIR socket: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		pubSocket->markOpen();
+		directSocket->markOpen();
+		directSocket->applyConfig(config);
 
-		if ((returnValue = nng_rep0_open(&repSocket->get())) != 0)
+		if ((returnValue = nng_pipe_notify(directSocket->get(), NNG_PIPE_EV_REM_POST, DirectPipeEvents::onRemoved, this)) != 0)
 		{
-			throw std::runtime_error{ "Failed to open REP socket: " + std::string(nng_strerror(returnValue)) };
+			throw std::runtime_error{ "Failed to set PAIR pipe notification: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		repSocket->markOpen();
+		for (size_t lane = 0; lane < priorityCount; ++lane)
+		{
+			Priority priority = static_cast<Priority>(lane);
+			std::string pubSocketUrl = makeSocketUrl(url, port, PortOffset::publish(priority));
+			std::string repSocketUrl = makeSocketUrl(url, port, PortOffset::request(priority));
 
-		std::string pubSocketUrl = url + ":" + std::to_string(port);;
-		std::string repSocketUrl = url + ":" + std::to_string(port + 1);;
+			if ((returnValue = nng_listen(lanes[lane].pubSocket->get(), pubSocketUrl.c_str(), nullptr, 0)) != 0)
+			{
+				throw std::runtime_error{ "Failed to listen on PUB socket: " + std::string(nng_strerror(returnValue)) };
+			}
+
+			if ((returnValue = nng_listen(lanes[lane].repSocket->get(), repSocketUrl.c_str(), nullptr, 0)) != 0)
+			{
+				throw std::runtime_error{ "Failed to listen on REP socket: " + std::string(nng_strerror(returnValue)) };
+			}
+		}
 
-		//std::cout << "publisher socket url: " << pubSocketUrl << "\n";
-		//std::cout << "response socket url: " << repSocketUrl << "\n";
+		std::string directSocketUrl = makeSocketUrl(url, port, PortOffset::Direct);
 
-		if ((returnValue = nng_listen(pubSocket->get(), pubSocketUrl.c_str(), nullptr, 0)) != 0)
+		if ((returnValue = nng_listen(directSocket->get(), directSocketUrl.c_str(), nullptr, 0)) != 0)
 		{
-			throw std::runtime_error{ "Failed to listen on PUB socket: " + std::string(nng_strerror(returnValue)) };
+			throw std::runtime_error{ "Failed to listen on PAIR socket: " + std::string(nng_strerror(returnValue)) };
 		}
 
-		if ((returnValue = nng_listen(repSocket->get(), repSocketUrl.c_str(), nullptr, 0)) != 0)
+		if (cryptoWorkerCount > 0)
 		{
-			throw std::runtime_error{ "Failed to listen on REP socket: " + std::string(nng_strerror(returnValue)) };
+			cryptoPool = std::make_unique<CryptoPool>(cryptoWorkerCount);
+			directOrderedSender = std::make_unique<OrderedSender>(*directSocket, dropStatistics);
+
+			for (Lane& lane : lanes)
+			{
+				lane.orderedSender = std::make_unique<OrderedSender>(*lane.pubSocket, dropStatistics);
+			}
 		}
 
 		isRunning = true;
-		receiveThread = std::thread(&Server::receiveLoop, this);
+
+		for (Lane& lane : lanes)
+		{
+			for (size_t thread = 0; thread < std::max<size_t>(cryptoWorkerCount, 1); ++thread)
+			{
+				lane.receiveThreads.emplace_back(&Server::receiveLoop, this, std::ref(lane));
+			}
+		}
+
+		directReceiveThread = std::thread(&Server::directReceiveLoop, this);
 		isStarted = true;
 		this->url = url;
 
@@ -73,44 +227,532 @@ namespace EasyIPC
 		if (isRunning)
 		{
 			isRunning = false;
-			pubSocket->close();
-			repSocket->close();
 
-			if (receiveThread.joinable())
+			// No new emits from here on, and the ones that are already running are waited for. Not held any longer,
+			// a handler that emits on a receive thread would otherwise keep that thread from ever being joined.
+			isStarted = false;
 			{
-				receiveThread.join();
+				std::unique_lock<std::shared_mutex> emitLock(emitMutex);
 			}
 
-			isStarted = false;
+			// send whatever was emitted before shutting down
+			if (cryptoPool)
+			{
+				cryptoPool->stop();
+				cryptoPool.reset();
+			}
+
+			for (Lane& lane : lanes)
+			{
+				lane.pubSocket->close();
+				lane.repSocket->close();
+			}
+
+			directSocket->close();
+
+			for (Lane& lane : lanes)
+			{
+				for (std::thread& receiveThread : lane.receiveThreads)
+				{
+					if (receiveThread.joinable())
+					{
+						receiveThread.join();
+					}
+				}
+
+				lane.receiveThreads.clear();
+				lane.orderedSender.reset();
+			}
+
+			directOrderedSender.reset();
+
+			if (directReceiveThread.joinable())
+			{
+				directReceiveThread.join();
+			}
+
+			std::lock_guard<std::mutex> clientLock(clientMutex);
+			clientPipes.clear();
+			pipeClients.clear();
+			pipeSessions.clear();
 		}
 	}
 
+	void Server::setCryptoWorkers(size_t count)
+	{
+		if (isStarted)
+		{
+			throw std::runtime_error{ "[EasyIPC::Server::setCryptoWorkers] Crypto workers can only be set before serving." };
+		}
+
+		cryptoWorkerCount = count;
+	}
+
+	void Server::setEventPriority(const std::string& event, Priority priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventPriorities[event] = priority;
+	}
+
+	Priority Server::getEventPriority(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		auto priority = eventPriorities.find(event);
+		return priority != eventPriorities.end() ? priority->second : Priority::Normal;
+	}
+
+	void Server::setEventProtection(const std::string& event, Protection protection)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		eventProtections[event] = protection;
+	}
+
+	Protection Server::getEventProtection(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		auto protection = eventProtections.find(event);
+		return protection != eventProtections.end() ? protection->second : Protection::Encrypt;
+	}
+
+	void Server::setDeltaEncoding(const std::string& event, uint32_t keyframeInterval)
+	{
+		std::lock_guard<std::mutex> lock(sequenceMutex);
+
+		if (keyframeInterval == 0)
+		{
+			deltaStates.erase(event);
+			return;
+		}
+
+		// starts over with a keyframe
+		auto state = std::make_shared<DeltaState>();
+		state->keyframeInterval = keyframeInterval;
+		state->sinceKeyframe = 0;
+		deltaStates[event] = std::move(state);
+	}
+
+	std::shared_ptr<Server::DeltaState> Server::findDeltaState(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock(sequenceMutex);
+
+		auto delta = deltaStates.find(event);
+		return delta != deltaStates.end() ? delta->second : nullptr;
+	}
+
+	EnvelopeKind Server::encodeDelta(DeltaState& state, const nlohmann::json& value, nlohmann::json& patch)
+	{
+		EnvelopeKind kind = EnvelopeKind::Keyframe;
+
+		// every so often the whole value, so clients that just connected or lost a message can catch up
+		if (state.previous && state.sinceKeyframe + 1 < state.keyframeInterval)
+		{
+			patch = nlohmann::json::diff(*state.previous, value);
+
+			// e.g. when most of the value changed, then the whole value is cheaper and lets clients catch up too
+			if (!serializesLargerThan(value, serializedSize(patch)))
+			{
+				patch = nullptr;
+			}
+			else
+			{
+				kind = EnvelopeKind::Delta;
+			}
+		}
+
+		state.sinceKeyframe = kind == EnvelopeKind::Delta ? state.sinceKeyframe + 1 : 0;
+		state.previous = value;
+		return kind;
+	}
+
+	bool Server::isProtectedAsExpected(const std::string& event, Protection protection)
+	{
+		// without a strategy nothing is protected anyway
+		if (!encryptionStrategy || isProtectedEnough(protection, getEventProtection(event)))
+			return true;
+
+		// someone is sending us a weaker message than we agreed on, e.g. plaintext where it should be encrypted
+		encryptionStrategy->reportCompromised();
+		return false;
+	}
+
 	void Server::emit(const std::string& event, const nlohmann::json& data)
 	{
+		emitData(event, data);
+	}
+
+	void Server::emitRaw(const std::string& event, std::span<const std::byte> data)
+	{
+		emitData(event, data);
+	}
+
+	void Server::emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments)
+	{
+		emitData(event, AttachedData{ metadata, attachments, plainTextOffset(encryptionStrategy.get(), getEventProtection(event)) });
+	}
+
+	PreparedMessage Server::prepare(const std::string& event, const nlohmann::json& data)
+	{
+		PreparedMessage prepared;
+		prepared.event = event;
+		prepared.priority = getEventPriority(event);
+		prepared.protection = getEventProtection(event);
+		prepared.plainText = std::make_shared<const std::string>(writeEnvelope(event, data));
+
+		// nothing about a plaintext message changes from one emit to the next, so it can be finished right away.
+		// Without a strategy every message goes out as plaintext.
+		if (!encryptionStrategy || prepared.protection == Protection::Plaintext)
+		{
+			prepared.message = std::make_shared<const NngMessage>(sealEvent(encryptionStrategy.get(), prepared.protection, *prepared.plainText));
+		}
+
+		return prepared;
+	}
+
+	void Server::emit(const PreparedMessage& prepared)
+	{
+		// keeps shutdown() from tearing down the sockets, the crypto pool and the ordered senders while we use them
+		std::shared_lock<std::shared_mutex> emitLock(emitMutex);
+
+		if (!isStarted)
+		{
+			throw std::runtime_error{ "[EasyIPC::Server::emit] Server is not started" };
+		}
+
+		// e.g. one that was moved from
+		if (!prepared.plainText)
+		{
+			throw std::runtime_error{ "[EasyIPC::Server::emit] The prepared message is empty" };
+		}
+
+		Lane& lane = lanes[static_cast<size_t>(prepared.priority)];
+
+		// a message finished without a strategy cant be used once there is one, unless it is plaintext anyway
+		std::shared_ptr<EncryptionStrategy> strategy = encryptionStrategy;
+		bool isFinished = prepared.message && (!strategy || prepared.protection == Protection::Plaintext);
+
+		if (cryptoPool)
+		{
+			OrderedSender& sender = *lane.orderedSender;
+			uint64_t ticket = sender.reserve();
+
+			// nothing to seal, it only has to wait for its turn
+			if (isFinished)
+			{
+				sender.complete(ticket, prepared.message->duplicate(), { prepared.event });
+				return;
+			}
+
+			cryptoPool->post([&sender, ticket, event = prepared.event, plainText = prepared.plainText, strategy, protection = prepared.protection]
+			{
+				NngMessage message;
+
+				try
+				{
+					message = sealEvent(strategy.get(), protection, *plainText);
+				}
+				catch (const std::exception& exception)
+				{
+					std::cerr << "[EasyIPC::Server::emit] Exception: " << exception.what() << "\n";
+				}
+
+				// even if it failed, otherwise everything after it would wait forever
+				sender.complete(ticket, std::move(message), { event });
+			});
+
+			return;
+		}
+
+		// anything else needs a fresh nonce every time
+		NngMessage message = isFinished
+			? prepared.message->duplicate()
+			: sealEvent(strategy.get(), prepared.protection, *prepared.plainText);
+
+		int returnValue = message.send(lane.pubSocket->get());
+		if (returnValue != 0)
+		{
+			dropStatistics.countSend(prepared.event);
+			throw std::runtime_error{ "Failed to send message: " + std::string(nng_strerror(returnValue)) };
+		}
+	}
+
+	template<typename Data>
+	void Server::emitData(const std::string& event, const Data& data)
+	{
+		std::shared_lock<std::shared_mutex> emitLock(emitMutex);
 		if (!isStarted)
 		{
 			throw std::runtime_error{ "[EasyIPC::Server::emit] Server is not started" };
 		}
 
-		nlohmann::json messageJson = {
-			{"event", event},
-			{"data", data}
+		Lane& lane = lanes[static_cast<size_t>(getEventPriority(event))];
+
+		uint64_t sequence{};
+		uint64_t ticket{};
+
+		// for delta encoded events this becomes the patch instead of the whole value
+		const Data* payload = &data;
+		EnvelopeKind kind = EnvelopeKind::Value;
+		nlohmann::json patch;
+
+		std::shared_ptr<DeltaState> delta = findDeltaState(event);
+		std::unique_lock<std::mutex> deltaLock;
+
+		if (delta)
+		{
+			// clients would see the sequence go by without the delta state changing and drop the next delta
+			if constexpr (!std::is_same_v<Data, nlohmann::json>)
+			{
+				throw std::runtime_error{ "[EasyIPC::Server::emit] " + event + " is delta encoded, it can only be emitted as json" };
+			}
+
+			deltaLock = std::unique_lock<std::mutex>(delta->mutex);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sequenceMutex);
+			sequence = ++eventSequences[event];
+
+			// taken together with the sequence number, so the messages go out in sequence order
+			if (cryptoPool)
+			{
+				ticket = lane.orderedSender->reserve();
+			}
+		}
+
+		if constexpr (std::is_same_v<Data, nlohmann::json>)
+		{
+			if (delta)
+			{
+				kind = encodeDelta(*delta, data, patch);
+				if (kind == EnvelopeKind::Delta)
+				{
+					payload = &patch;
+				}
+
+				deltaLock.unlock();
+			}
+		}
+
+		if (cryptoPool)
+		{
+			std::vector<OutgoingEvent> records;
+			records.push_back({ event, writeEnvelope(event, *payload, sequence, kind) });
+
+			sealInBackground(*lane.orderedSender, ticket, std::move(records), encryptionStrategy, getEventProtection(event), 0);
+			return;
+		}
+
+		NngMessage message = sealEvent(encryptionStrategy.get(), getEventProtection(event), writeEnvelopeToThreadBuffer(event, *payload, sequence, kind));
+
+		int returnValue = message.send(lane.pubSocket->get());
+		if (returnValue != 0)
+		{
+			dropStatistics.countSend(event);
+			throw std::runtime_error{ "Failed to send message: " + std::string(nng_strerror(returnValue)) };
+		}
+	}
+
+	void Server::emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events)
+	{
+		std::shared_lock<std::shared_mutex> emitLock(emitMutex);
+		if (!isStarted)
+		{
+			throw std::runtime_error{ "[EasyIPC::Server::emitBatch] Server is not started" };
+		}
+
+		if (events.empty())
+			return;
+
+		// one message can only go out once, so it takes the most urgent lane and the strongest protection of its events
+		Priority priority = Priority::Normal;
+		Protection protection = Protection::Plaintext;
+
+		for (const auto& [event, data] : events)
+		{
+			if (getEventPriority(event) == Priority::Control)
+			{
+				priority = Priority::Control;
+			}
+
+			protection = strongerProtection(protection, getEventProtection(event));
+		}
+
+		Lane& lane = lanes[static_cast<size_t>(priority)];
+
+		std::vector<uint64_t> sequences;
+		sequences.reserve(events.size());
+		std::vector<EnvelopeKind> kinds;
+		kinds.reserve(events.size());
+		std::vector<nlohmann::json> patches(events.size());
+		uint64_t ticket{};
+
+		std::vector<std::shared_ptr<DeltaState>> deltas;
+		deltas.reserve(events.size());
+
+		for (const auto& [event, data] : events)
+		{
+			deltas.push_back(findDeltaState(event));
+		}
+
+		// every state once and always in the same order, so batches with the same events cant deadlock each other
+		std::vector<DeltaState*> statesToLock;
+		for (const std::shared_ptr<DeltaState>& delta : deltas)
+		{
+			if (delta)
+			{
+				statesToLock.push_back(delta.get());
+			}
+		}
+
+		std::sort(statesToLock.begin(), statesToLock.end(), std::less<>{});
+		statesToLock.erase(std::unique(statesToLock.begin(), statesToLock.end()), statesToLock.end());
+
+		std::vector<std::unique_lock<std::mutex>> deltaLocks;
+		for (DeltaState* state : statesToLock)
+		{
+			deltaLocks.emplace_back(state->mutex);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sequenceMutex);
+			for (const auto& [event, data] : events)
+			{
+				sequences.push_back(++eventSequences[event]);
+			}
+
+			if (cryptoPool)
+			{
+				ticket = lane.orderedSender->reserve();
+			}
+		}
+
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			kinds.push_back(deltas[i] ? encodeDelta(*deltas[i], events[i].second, patches[i]) : EnvelopeKind::Value);
+		}
+
+		deltaLocks.clear();
+
+		auto writeRecord = [&](size_t i)
+		{
+			const nlohmann::json& payload = kinds[i] == EnvelopeKind::Delta ? patches[i] : events[i].second;
+			return writeEnvelope(events[i].first, payload, sequences[i], kinds[i]);
 		};
 
-		std::string message = messageJson.dump();
+		if (cryptoPool)
+		{
+			std::vector<OutgoingEvent> records;
+			records.reserve(events.size());
+
+			for (size_t i = 0; i < events.size(); ++i)
+			{
+				records.push_back({ events[i].first, writeRecord(i) });
+			}
+
+			sealInBackground(*lane.orderedSender, ticket, std::move(records), encryptionStrategy, protection, 0);
+			return;
+		}
+
+		std::vector<std::string> plainRecords;
+		plainRecords.reserve(events.size());
+
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			plainRecords.push_back(writeRecord(i));
+		}
+
+		NngMessage message = sealBatch(encryptionStrategy.get(), protection, plainRecords);
+
+		int returnValue = message.send(lane.pubSocket->get());
+		if (returnValue != 0)
+		{
+			for (const auto& [event, data] : events)
+			{
+				dropStatistics.countSend(event);
+			}
+
+			throw std::runtime_error{ "Failed to send batch: " + std::string(nng_strerror(returnValue)) };
+		}
+	}
+
+	void Server::emitTo(const std::string& clientId, const std::string& event, const nlohmann::json& data)
+	{
+		std::shared_lock<std::shared_mutex> emitLock(emitMutex);
+		if (!isStarted)
+		{
+			throw std::runtime_error{ "[EasyIPC::Server::emitTo] Server is not started" };
+		}
+
+		nng_pipe pipe = NNG_PIPE_INITIALIZER;
+		std::shared_ptr<EncryptionStrategy> strategy = encryptionStrategy;
 
-		if (encryptionStrategy)
 		{
-			message = encryptionStrategy->encrypt(message);
+			std::lock_guard<std::mutex> lock(clientMutex);
+			auto client = clientPipes.find(clientId);
+			if (client == clientPipes.end())
+			{
+				throw std::runtime_error{ "[EasyIPC::Server::emitTo] No client connected with id: " + clientId };
+			}
+
+			pipe.id = client->second;
+
+			auto session = pipeSessions.find(pipe.id);
+			if (session != pipeSessions.end())
+			{
+				strategy = session->second;
+			}
 		}
 
-		int returnValue = nng_send(pubSocket->get(), message.data(), message.size(), 0);
+		if (cryptoPool)
+		{
+			std::vector<OutgoingEvent> records;
+			records.push_back({ event, writeEnvelope(event, data) });
+
+			sealInBackground(*directOrderedSender, directOrderedSender->reserve(), std::move(records), std::move(strategy),
+				getEventProtection(event), pipe.id);
+			return;
+		}
+
+		NngMessage message = sealEvent(strategy.get(), getEventProtection(event), writeEnvelopeToThreadBuffer(event, data));
+
+		// this is what makes the polyamorous pair socket send to only this one client
+		nng_msg_set_pipe(message.get(), pipe);
+
+		int returnValue = message.send(directSocket->get());
 		if (returnValue != 0)
 		{
+			dropStatistics.countSend(event);
 			throw std::runtime_error{ "Failed to send message: " + std::string(nng_strerror(returnValue)) };
 		}
 	}
 
+	std::vector<std::string> Server::getClientIds()
+	{
+		std::lock_guard<std::mutex> lock(clientMutex);
+
+		std::vector<std::string> clientIds;
+		clientIds.reserve(clientPipes.size());
+
+		for (const auto& [clientId, pipeId] : clientPipes)
+		{
+			clientIds.push_back(clientId);
+		}
+
+		return clientIds;
+	}
+
+	std::unordered_map<std::string, DropCounters> Server::getDropCounters()
+	{
+		return dropStatistics.get();
+	}
+
+	void Server::resetDropCounters()
+	{
+		dropStatistics.reset();
+	}
+
 	void Server::setOnCompromisedCallback(const std::function<void()>& callback)
 	{
 		if (encryptionStrategy)
@@ -124,13 +766,61 @@ namespace EasyIPC
 		encryptionStrategy = strategy;
 	}
 
-	void Server::receiveLoop()
+	void Server::sealInBackground(OrderedSender& sender, uint64_t ticket, std::vector<OutgoingEvent> records,
+		std::shared_ptr<EncryptionStrategy> strategy, Protection protection, uint32_t pipeId)
+	{
+		cryptoPool->post([&sender, ticket, records = std::move(records), strategy = std::move(strategy), protection, pipeId]() mutable
+		{
+			NngMessage message;
+			std::vector<std::string> events;
+
+			try
+			{
+				std::vector<std::string> plainRecords;
+				plainRecords.reserve(records.size());
+
+				for (OutgoingEvent& record : records)
+				{
+					events.push_back(std::move(record.event));
+					plainRecords.push_back(std::move(record.plainText));
+				}
+
+				message = plainRecords.size() == 1
+					? sealEvent(strategy.get(), protection, plainRecords.front())
+					: sealBatch(strategy.get(), protection, plainRecords);
+
+				if (pipeId != 0)
+				{
+					nng_pipe pipe = NNG_PIPE_INITIALIZER;
+					pipe.id = pipeId;
+					nng_msg_set_pipe(message.get(), pipe);
+				}
+			}
+			catch (const std::exception& exception)
+			{
+				std::cerr << "[EasyIPC::Server::sealInBackground] Exception: " << exception.what() << "\n";
+			}
+
+			// even if it failed, otherwise everything after it would wait forever
+			sender.complete(ticket, std::move(message), std::move(events));
+		});
+	}
+
+	void Server::receiveLoop(Lane& lane)
 	{
+		// every thread has its own context, so with crypto workers several requests of the same priority are handled at once
+		nng_ctx context;
+		int returnValue = nng_ctx_open(&context, lane.repSocket->get());
+		if (returnValue != 0)
+		{
+			std::cerr << "[EasyIPC::Server::receiveLoop] Failed to open context: " << nng_strerror(returnValue) << "\n";
+			return;
+		}
+
 		while (isRunning)
 		{
-			void* buffer = nullptr;
-			size_t size = 0;
-			int returnValue = nng_recv(repSocket->get(), &buffer, &size, NNG_FLAG_ALLOC);
+			NngMessage message;
+			returnValue = message.receive(context);
 
 			if (returnValue == NNG_ECLOSED)
 				break;
@@ -140,98 +830,342 @@ namespace EasyIPC
 				continue;
 			}
 
-			std::string message(static_cast<char*>(buffer), size);
-			nng_free(buffer, size);
+			NngMessage response = handleRequest(message);
 
-			handleRequest(message);
+			returnValue = response.send(context);
+			if (returnValue != 0)
+			{
+				std::cerr << "[EasyIPC::Server::receiveLoop] Failed to send response: " << nng_strerror(returnValue) << "\n";
+			}
 		}
+
+		nng_ctx_close(context);
 	}
 
-	void Server::handleRequest(const std::string& message)
+	void Server::directReceiveLoop()
 	{
-		try
+		while (isRunning)
 		{
-			std::string plainMessage = message;
+			NngMessage message;
+			int returnValue = message.receive(directSocket->get());
 
-			if (encryptionStrategy)
+			if (returnValue == NNG_ECLOSED)
+				break;
+			if (returnValue != 0)
 			{
-				plainMessage = encryptionStrategy->decrypt(message);
+				std::cerr << "[EasyIPC::Server::directReceiveLoop] Receive error: " << nng_strerror(returnValue) << "\n";
+				continue;
 			}
 
-			nlohmann::json messageJson = nlohmann::json::parse(plainMessage);
-			std::string event = messageJson["event"];
-			nlohmann::json data = messageJson["data"];
+			uint32_t pipeId = static_cast<uint32_t>(nng_pipe_id(nng_msg_get_pipe(message.get())));
+			handleHello(pipeId, message);
+		}
+	}
 
-			std::optional<nlohmann::json> handlerResponse;
+	void Server::handleHello(uint32_t pipeId, NngMessage& message)
+	{
+		try
+		{
+			std::shared_ptr<EncryptionStrategy> strategy = encryptionStrategy;
+			std::shared_ptr<SessionCipher> session;
 
+			// the client did its handshake over the REQ socket already, so we know its session
+			auto* sessions = dynamic_cast<SessionEncryptionStrategy*>(strategy.get());
+			if (sessions)
 			{
-				std::lock_guard<std::mutex> lock(handlerMutex);
-				if (eventHandlers.contains(event))
+				session = sessions->findSession(sealedPart(strategy.get(), message));
+				if (!session)
 				{
-					handlerResponse = eventHandlers[event](data);
+					std::cerr << "[EasyIPC::Server::handleHello] Ignoring message without known session.\n";
+					return;
 				}
-				else
+
+				strategy = session;
+			}
+
+			std::string fallback;
+			OpenedEvent opened = openEvent(strategy.get(), message, fallback);
+
+			Envelope envelope = readEnvelope(opened.plainText);
+			std::string event{ envelope.event };
+
+			// Clients only ever use the direct socket to tell us who they are, events go through the REQ socket
+			if (event != "__hello__")
+			{
+				std::cerr << "[EasyIPC::Server::handleHello] Ignoring event " << event << " sent over the direct socket.\n";
+				return;
+			}
+
+			// otherwise anybody could claim the id of another client and get its events
+			if (encryptionStrategy && opened.protection != Protection::Encrypt)
+			{
+				encryptionStrategy->reportCompromised();
+				std::cerr << "[EasyIPC::Server::handleHello] Ignoring hello that isnt encrypted.\n";
+				return;
+			}
+
+			std::string clientId = envelope.parseData()["clientId"];
+
+			std::lock_guard<std::mutex> lock(clientMutex);
+
+			// the same connection might introduce itself again, e.g. after a reconnect
+			auto previous = pipeClients.find(pipeId);
+			if (previous != pipeClients.end())
+			{
+				clientPipes.erase(previous->second);
+			}
+
+			clientPipes[clientId] = pipeId;
+			pipeClients[pipeId] = clientId;
+
+			if (session)
+			{
+				// after a new handshake over the same connection the old session is of no use anymore
+				auto previousSession = pipeSessions.find(pipeId);
+				if (previousSession != pipeSessions.end() && previousSession->second != session)
 				{
-					std::cerr << "[EasyIPC::Server::handleRequest] Received event " << event << " but no handler was bound for it.\n";
-					std::string missingHandlerLabel = "Server has no handler bound for event: " + event;
-					handlerResponse = {
-						{"event", "__error__"},
-						{"data", {
-							{"message", missingHandlerLabel }
-						}}
-					};
+					endSession(*previousSession->second);
 				}
+
+				pipeSessions[pipeId] = session;
+
+				// the session belongs to a connected client now, handshakes of others cant push it out anymore
+				sessions->bindSession(session->getId());
 			}
+		}
+		catch (const std::exception& exception)
+		{
+			std::cerr << "[EasyIPC::Server::handleHello] Exception: " << exception.what() << "\n";
+		}
+	}
 
-			nlohmann::json responseJson;
+	void Server::forgetClient(uint32_t pipeId)
+	{
+		std::lock_guard<std::mutex> lock(clientMutex);
 
-			responseJson = handlerResponse.value_or(nlohmann::json{
-				{"event", "__response__"},
-				{"data", {
-					{"status", "success"}
-				}}
-				});
+		auto client = pipeClients.find(pipeId);
+		if (client == pipeClients.end())
+			return;
 
+		// another connection might have claimed the id in the meantime
+		auto pipe = clientPipes.find(client->second);
+		if (pipe != clientPipes.end() && pipe->second == pipeId)
+		{
+			clientPipes.erase(pipe);
+		}
 
-			std::string response = responseJson.dump();
+		pipeClients.erase(client);
 
-			if (encryptionStrategy)
+		auto session = pipeSessions.find(pipeId);
+		if (session != pipeSessions.end())
+		{
+			endSession(*session->second);
+			pipeSessions.erase(session);
+		}
+	}
+
+	void Server::endSession(SessionCipher& session)
+	{
+		if (auto* sessions = dynamic_cast<SessionEncryptionStrategy*>(encryptionStrategy.get()))
+		{
+			sessions->endSession(session.getId());
+		}
+	}
+
+	NngMessage Server::handleRequest(NngMessage& message)
+	{
+		// with sessions the request is decrypted and answered with the keys of the session it belongs to
+		std::shared_ptr<EncryptionStrategy> strategy = encryptionStrategy;
+
+		auto* sessions = dynamic_cast<SessionEncryptionStrategy*>(strategy.get());
+		bool isPlaintext = !message.body().empty() && (message.body()[0] & ~batchFlag) == static_cast<uint8_t>(Protection::Plaintext);
+
+		// plaintext requests dont need a session
+		if (sessions && !isPlaintext)
+		{
+			try
 			{
-				response = encryptionStrategy->encrypt(response);
+				std::shared_ptr<SessionCipher> session = sessions->findSession(sealedPart(strategy.get(), message));
+
+				// handshakes and requests of sessions we dont know (anymore) are answered without encryption
+				if (!session)
+				{
+					return rawMessage(sessions->respond(message.body()));
+				}
+
+				strategy = session;
 			}
+			catch (const std::exception& exception)
+			{
+				// the REQ socket of the client waits for an answer, so it gets one
+				std::cerr << "[EasyIPC::Server::handleRequest] Handshake failed: " << exception.what() << "\n";
+				return rawMessage(sessions->reject());
+			}
+		}
 
-			int returnValue = nng_send(repSocket->get(), response.data(), response.size(), 0);
-			if (returnValue != 0)
+		// the response is protected like the request event, if we dont get that far its an error protected like the request claims to be
+		Protection responseProtection = Protection::Encrypt;
+		std::optional<nlohmann::json> response;
+		std::vector<std::string> batchResponses;
+		bool isBatch = false;
+
+		try
+		{
+			std::string fallback;
+			OpenedEvent opened = openEvent(strategy.get(), message, fallback);
+
+			if (opened.isBatch)
 			{
-				std::cerr << "[EasyIPC::Server::handleRequest] Failed to send response: " << nng_strerror(returnValue) << "\n";
+				// the whole batch was authenticated at once, the responses go back the same way in the same order
+				std::vector<std::string_view> records = splitBatch(opened.plainText);
+				isBatch = true;
+				responseProtection = Protection::Plaintext;
+
+				for (std::string_view record : records)
+				{
+					Protection recordProtection{};
+					std::optional<nlohmann::json> recordResponse = handleEvent(record, opened.protection, recordProtection);
+					batchResponses.push_back(recordResponse ? recordResponse->dump() : std::string{ acknowledgement });
+					responseProtection = strongerProtection(responseProtection, recordProtection);
+				}
+			}
+			else
+			{
+				response = handleEvent(opened.plainText, opened.protection, responseProtection);
 			}
 		}
-		catch (std::exception& exception)
+		catch (const std::exception& exception)
 		{
 			std::cerr << "[EasyIPC::Server::handleRequest] Exception: " << exception.what() << "\n";
+			dropStatistics.countReceive("");
+
+			isBatch = false;
+			response = errorResponse(exception.what());
+
+			// like handleEvent, the error goes back as protected as the request was. A plaintext request under sessions has
+			// no session cipher, so anything but plaintext would be sealed with a key the client doesnt have.
+			// Empty requests and unknown protections get the strongest one.
+			std::span<uint8_t> body = message.body();
+			auto requestProtection = body.empty() ? Protection::Encrypt : static_cast<Protection>(body[0] & ~batchFlag);
+			bool isKnown = requestProtection == Protection::Authenticate || requestProtection == Protection::Plaintext;
+			responseProtection = isKnown ? requestProtection : Protection::Encrypt;
+		}
+
+		try
+		{
+			return isBatch
+				? sealBatch(strategy.get(), responseProtection, batchResponses)
+				: sealEvent(strategy.get(), responseProtection, response ? dumpToThreadBuffer(*response) : acknowledgement);
+		}
+		catch (const std::exception& exception)
+		{
+			// the client would wait for an answer forever, a plaintext error at least tells it something went wrong
+			std::cerr << "[EasyIPC::Server::handleRequest] Failed to encrypt response: " << exception.what() << "\n";
+			return sealEvent(nullptr, Protection::Plaintext, errorResponse("Failed to encrypt response").dump());
+		}
+	}
+
+	std::optional<nlohmann::json> Server::handleEvent(std::string_view plainText, Protection protection, Protection& responseProtection)
+	{
+		// stays empty until the message is parsed
+		std::string event;
+
+		// if we dont get as far as knowing the event, the error goes back as protected as the request was
+		responseProtection = protection;
+
+		try
+		{
+			Envelope envelope = readEnvelope(plainText);
+			std::string messageEvent{ envelope.event };
+
+			// a request that is protected less than its event requires is never handed to the handler
+			if (!isProtectedAsExpected(messageEvent, protection))
+			{
+				throw std::runtime_error{ "Event " + messageEvent + " arrived with weaker protection than expected" };
+			}
+
+			event = messageEvent;
+			responseProtection = getEventProtection(event);
 
-			nlohmann::json responseJson = {
-			{"event", "__response__"},
-			{"data",
+			EventHandler handler;
+
+			{
+				std::lock_guard<std::mutex> lock(handlerMutex);
+				auto boundHandler = eventHandlers.find(event);
+				if (boundHandler != eventHandlers.end())
 				{
-						{"status", "error"},
-						{"message", exception.what()}
-					}
-			   }
+					handler = boundHandler->second;
+				}
+			}
+
+			// called without holding the lock, otherwise a slow handler of one priority would block the others
+			if (!handler.handler && !handler.viewHandler && !handler.arenaHandler && !handler.rawHandler)
+			{
+				dropStatistics.countReceive(event);
+				std::cerr << "[EasyIPC::Server::handleEvent] Received event " << event << " but no handler was bound for it.\n";
+				std::string missingHandlerLabel = "Server has no handler bound for event: " + event;
+				return nlohmann::json{
+					{"event", "__error__"},
+					{"data", {
+						{"message", missingHandlerLabel }
+					}}
+				};
+			}
+
+			// only parsed now that we know someone wants it, and only into what the handler wants
+			std::string_view dataText = envelope.data.empty() ? std::string_view{ "null" } : envelope.data;
+			auto parseOrDrop = [&](auto parse)
+			{
+				try
+				{
+					return parse();
+				}
+				catch (const std::exception&)
+				{
+					dropStatistics.countReceive(event);
+					throw;
+				}
 			};
 
-			std::string response = responseJson.dump();
+			std::optional<nlohmann::json> response;
 
-			if (encryptionStrategy)
+			if (handler.rawHandler)
+			{
+				// nothing to parse
+				response = handler.rawHandler(envelope.rawData());
+			}
+			else if (handler.arenaHandler)
+			{
+				// the data has to be gone before the scope releases the arena
+				MessageArena::Scope arenaScope;
+				ArenaJson data = parseOrDrop([&] { return ArenaJson::parse(dataText); });
+				response = handler.arenaHandler(data);
+			}
+			else if (handler.viewHandler)
+			{
+				DataView::Document document;
+				DataView data = parseOrDrop([&] { return document.parse(dataText); });
+				response = handler.viewHandler(data);
+			}
+			else
 			{
-				response = encryptionStrategy->encrypt(response);
+				nlohmann::json data = parseOrDrop([&] { return envelope.parseData(); });
+				response = handler.handler(data);
 			}
 
-			int returnValue = nng_send(repSocket->get(), response.data(), response.size(), 0);
-			if (returnValue != 0)
+			return response;
+		}
+		catch (std::exception& exception)
+		{
+			std::cerr << "[EasyIPC::Server::handleEvent] Exception: " << exception.what() << "\n";
+
+			// otherwise it was the handler that threw, the message itself made it
+			if (event.empty())
 			{
-				std::cerr << "[EasyIPC::Server::handleRequest] Failed to send response: " << nng_strerror(returnValue) << "\n";
+				dropStatistics.countReceive(event);
 			}
+
+			return errorResponse(exception.what());
 		}
 	}
 }
\ No newline at end of file
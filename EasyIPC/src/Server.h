@@ -2,19 +2,41 @@
 
 
 
+#include <array>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <span>
+#include <vector>
+#include <optional>
+#include <cstddef>
+#include <utility>
+#include <string_view>
 #include <atomic>
 #include <unordered_map>
 #include <functional>
 #include <nlohmann/json.hpp>
 
 #include "Encryption/EncryptionStrategy.h"
+#include "ConnectionConfig.h"
+#include "DropCounters.h"
+#include "Priority.h"
+#include "PreparedMessage.h"
+#include "Protection.h"
+#include "DataView.h"
+#include "MessageArena.h"
+#include "Schema.h"
+#include "Attachment.h"
 
 namespace EasyIPC
 {
 	// Forward declare since users of this lib arent supposed to deal with nanomsg
 	class NngSocket;
+	class NngMessage;
+	class CryptoPool;
+	enum class EnvelopeKind : uint8_t;
+	class OrderedSender;
+	class SessionCipher;
 
 	class Server
 	{
@@ -25,7 +47,18 @@ namespace EasyIPC
 		// Start the server at the given url and port
 		// For simple local inter process communication use: tcp://localhost as url and any free port
 		// You HAVE to explicitly call this before clients can connect.
-		void serve(const std::string& url, uint16_t port);
+		// The config sets queue depths and the maximum message size of all sockets, see ConnectionConfig.
+		void serve(const std::string& url, uint16_t port, const ConnectionConfig& config = {});
+
+		// Encrypt and decrypt on this many threads instead of only the thread calling emit() and the one receiving requests,
+		// so encrypted throughput scales with cores. Has to be called before serve(), 0 (the default) turns it off.
+		// With workers:
+		// - requests are received, decrypted and handled by that many threads per priority, so handlers of the same
+		//   priority can run at the same time. Requests of one client are still handled one after another, since
+		//   a client waits for the response before it emits again.
+		// - emit() and emitTo() return once the message is queued, it is encrypted and sent in the background.
+		//   Messages are still sent in the order they were emitted. Failing to send no longer throws, it is only counted (see getDropCounters).
+		void setCryptoWorkers(size_t count);
 
 		// Manually shutdown the server
 		// Note: This also gets called in destructor
@@ -57,13 +90,110 @@ namespace EasyIPC
 		{
 			doSomething(data["someProperty"]);
 		});
+
+		Urgent events can be given a higher priority, see setEventPriority. Passing a priority here is the same as calling it,
+		without one the event keeps the priority it has.
 		*/
 		template<typename HandlerType>
-		void on(const std::string& event, HandlerType handler);
+		void on(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as on(), but the handler gets a read only DataView instead of a nlohmann::json, which is much cheaper
+		// to parse when the library is built with simdjson (see DataView). An event has either an on() or an onView() handler.
+		template<typename HandlerType>
+		void onView(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// Same as on(), but the data is parsed into an ArenaJson that allocates from a per thread arena,
+		// which is released at once after the handler returned (see MessageArena). The data must not outlive the handler.
+		template<typename HandlerType>
+		void onArena(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// For events emitted with Client::emitRaw, the handler gets the bytes exactly as they were emitted, no json involved.
+		// It can return a response just like with on().
+		//
+		// server.onRaw("frame", [](std::span<const std::byte> bytes) { decodeFrame(bytes); });
+		template<typename HandlerType>
+		void onRaw(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// For events emitted with Client::emitFixed, the handler gets the struct back without any parsing, see Schema.h.
+		// It can return a response just like with on(). Messages with a different layout throw before the handler is called.
+		//
+		// server.onFixed<Order>("order", [](const Order& order) { ... });
+		template<FixedLayout T, typename HandlerType>
+		void onFixed(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// For events emitted with Client::emitAttachments, the handler gets the json metadata and the attachments,
+		// which point straight into the request and are only valid until the handler returns, see Attachment.
+		// It can return a response just like with on().
+		//
+		// server.onAttachments("frame", [](const nlohmann::json& metadata, std::span<const EasyIPC::Attachment> attachments)
+		// {
+		//     std::span<const float> pixels = attachments[0].as<float>();
+		// });
+		template<typename HandlerType>
+		void onAttachments(const std::string& event, HandlerType handler, std::optional<Priority> priority = std::nullopt);
+
+		// Events with Priority::Control are sent and received over their own sockets with their own receive thread,
+		// so they never have to wait behind large Priority::Normal messages or slow Priority::Normal handlers.
+		// This decides which sockets emit() uses for the event, the clients have to set the same priority for
+		// the events they emit. Note: handlers of different priorities can run at the same time.
+		void setEventPriority(const std::string& event, Priority priority);
+
+		// How this event is protected by the encryption strategy, Protection::Encrypt by default. Applies to emit(), emitTo(),
+		// received requests and the responses to them. The clients have to set the same protection for the event,
+		// requests protected less than expected are answered with an error and invoke the compromised callback.
+		void setEventProtection(const std::string& event, Protection protection);
+
+		// For large values that only change a little from one emit() to the next, e.g. a state feed: instead of the whole value
+		// only a JSON Patch against the previously emitted value is sent. Every keyframeInterval emits the whole value is sent again,
+		// clients that just connected or lost a message skip the event until then. Clients turn it back into the whole value
+		// before their handler sees it, so nothing changes for them. 0 turns it off again.
+		// Only applies to emit() and emitBatch() of json data, emitRaw(), emitFixed() and emitAttachments() of the event throw.
+		// Emit the event from one thread so the deltas go out in order.
+		void setDeltaEncoding(const std::string& event, uint32_t keyframeInterval = 100);
 
 		// Emit an event to ALL connected clients with optional data (json object)
 		void emit(const std::string& event, const nlohmann::json& data = {});
 
+		// Same as emit(), but the data are raw bytes, e.g. an image or a protobuf message. They are still protected like
+		// any other event, but never turned into json, so there is no need to base64 them. The clients need an onRaw() handler.
+		void emitRaw(const std::string& event, std::span<const std::byte> data);
+
+		// Emit a struct declared with EASYIPC_SCHEMA to ALL connected clients, its sent as it is instead of as json, see Schema.h
+		template<FixedLayout T>
+		void emitFixed(const std::string& event, const T& value) { emitRaw(event, writeFixed(value)); }
+
+		// Emit json metadata together with binary attachments to ALL connected clients, e.g. a frame with its width and height.
+		// The attachments are copied into the message as they are and protected together with the metadata,
+		// the clients need an onAttachments() handler. Never delta encoded.
+		void emitAttachments(const std::string& event, const nlohmann::json& metadata, const std::vector<std::span<const std::byte>>& attachments);
+
+		// Serializes the event once so it can be emitted many times, see PreparedMessage.
+		// Set the priority and protection of the event before preparing it.
+		PreparedMessage prepare(const std::string& event, const nlohmann::json& data = {});
+
+		// Emit a prepared event to ALL connected clients
+		void emit(const PreparedMessage& prepared);
+
+		// Emit several events to ALL connected clients as one message, e.g. lots of small events that are produced together.
+		// The batch gets one nonce and one authentication tag instead of one per event, and the clients verify it once.
+		// It is sent with the most urgent priority and the strongest protection of its events.
+		//
+		// server.emitBatch({ {"tick", {{"price", 1.5}}}, {"tick", {{"price", 1.6}}} });
+		void emitBatch(const std::vector<std::pair<std::string, nlohmann::json>>& events);
+
+		// Emit an event to exactly one client, identified by the id it connected with (see Client::setClientId).
+		// Unlike emit() this doesnt go through the publisher socket, the message is only sent to and only processed by that one client.
+		// Throws if no client with that id is currently connected.
+		void emitTo(const std::string& clientId, const std::string& event, const nlohmann::json& data = {});
+
+		// Ids of all clients that are currently connected and have introduced themselves
+		std::vector<std::string> getClientIds();
+
+		// How many messages of each event got dropped on this side and where, see DropCounters.
+		// Messages lost on the way to the clients are counted by the clients.
+		std::unordered_map<std::string, DropCounters> getDropCounters();
+		void resetDropCounters();
+
 		// If you're using an encryption strategy and the communication is deemed compromised (e.g. message authentication code doesnt match)
 		// then this callback will be invoked, e.g. when someone is trying to tamper with the traffic, think Wireshark.
 		// The EncryptionStrategy subclass will need to support this feature, the provided AesEaxEncryptionStrategy does support this.
@@ -73,39 +203,139 @@ namespace EasyIPC
 		void setEncryptionStrategy(std::shared_ptr<EncryptionStrategy> strategy);
 
 	private:
-		void receiveLoop();
-		void handleRequest(const std::string& message);
+		// Each priority has its own pair of sockets and its own thread handling incoming requests
+		struct Lane
+		{
+			std::unique_ptr<NngSocket> pubSocket;
+			std::unique_ptr<NngSocket> repSocket;
+			std::vector<std::thread> receiveThreads;
+
+			// only used with crypto workers
+			std::unique_ptr<OrderedSender> orderedSender;
+		};
 
-		std::unique_ptr<NngSocket> pubSocket;
-		std::unique_ptr<NngSocket> repSocket;
+		void receiveLoop(Lane& lane);
+		void directReceiveLoop();
+		NngMessage handleRequest(NngMessage& message);
+
+		// An event waiting to be encrypted on the crypto pool. Its already serialized, which is cheaper than copying the json of the caller.
+		struct OutgoingEvent
+		{
+			std::string event;
+			std::string plainText;
+		};
+
+		template<typename Argument, typename HandlerType>
+		static std::function<std::optional<nlohmann::json>(const Argument&)> wrapHandler(HandlerType handler);
+
+		// emit(), emitRaw() and emitAttachments() only differ in how the data is written into the envelope
+		template<typename Data>
+		void emitData(const std::string& event, const Data& data);
+
+		struct DeltaState;
+
+		// The delta state of the event, nullptr if it isnt delta encoded
+		std::shared_ptr<DeltaState> findDeltaState(const std::string& event);
+
+		// Whether the value goes out as a keyframe or as a delta (then patch is set), call with the mutex of the state locked
+		static EnvelopeKind encodeDelta(DeltaState& state, const nlohmann::json& value, nlohmann::json& patch);
+
+		// Runs the handler of one event of a request, returns the response, nothing if its just an acknowledgement
+		std::optional<nlohmann::json> handleEvent(std::string_view plainText, Protection protection, Protection& responseProtection);
+
+		// Encrypts on the crypto pool, more than one record are sent as a batch.
+		// Messages with a pipe id only go to that client of the direct socket.
+		void sealInBackground(OrderedSender& sender, uint64_t ticket, std::vector<OutgoingEvent> records,
+			std::shared_ptr<EncryptionStrategy> strategy, Protection protection, uint32_t pipeId);
+		void handleHello(uint32_t pipeId, NngMessage& message);
+
+		void forgetClient(uint32_t pipeId);
+		void endSession(SessionCipher& session);
+
+		// Receives nng's pipe notifications for the direct socket, defined in Server.cpp
+		friend struct DirectPipeEvents;
+
+		Priority getEventPriority(const std::string& event);
+		Protection getEventProtection(const std::string& event);
+		bool isProtectedAsExpected(const std::string& event, Protection protection);
+
+		std::array<Lane, priorityCount> lanes;
+		std::unique_ptr<NngSocket> directSocket;
 
 		std::shared_ptr<EncryptionStrategy> encryptionStrategy;
 
+		size_t cryptoWorkerCount;
+		std::unique_ptr<CryptoPool> cryptoPool;
+		std::unique_ptr<OrderedSender> directOrderedSender;
+
 		// Map events to callbacks that get passed the message which is already parsed to json object
 		// Each handler can *optionally* return a response directly to the client who sent the message
 		// by simply returning from the handler. For handlers that don't need to respond simply dont return anything.
-		std::unordered_map<std::string, std::function<std::optional<nlohmann::json>(const nlohmann::json&)>> eventHandlers;
+		// Only one of them is set, depending on whether the handler was attached with on(), onView(), onArena() or onRaw()
+		struct EventHandler
+		{
+			std::function<std::optional<nlohmann::json>(const nlohmann::json&)> handler;
+			std::function<std::optional<nlohmann::json>(const DataView&)> viewHandler;
+			std::function<std::optional<nlohmann::json>(const ArenaJson&)> arenaHandler;
+			std::function<std::optional<nlohmann::json>(std::span<const std::byte>)> rawHandler;
+		};
+
+		std::unordered_map<std::string, EventHandler> eventHandlers;
+		std::unordered_map<std::string, Priority> eventPriorities;
+		std::unordered_map<std::string, Protection> eventProtections;
 		std::mutex handlerMutex;
 
-		std::thread receiveThread;
+		// Every event emitted to all clients is numbered, so clients can tell when they missed some
+		std::unordered_map<std::string, uint64_t> eventSequences;
+		std::mutex sequenceMutex;
+
+		// The last value of a delta encoded event, to diff the next one against.
+		// Its mutex is held from taking the sequence until the diff is done, so a delta always gets the sequence right after
+		// the value it was diffed against, while other events only wait for sequenceMutex as long as it takes to count.
+		struct DeltaState
+		{
+			uint32_t keyframeInterval;
+			uint32_t sinceKeyframe;
+			std::optional<nlohmann::json> previous;
+			std::mutex mutex;
+		};
+
+		// Also guarded by sequenceMutex, emits keep the state they found even if setDeltaEncoding() replaces it meanwhile
+		std::unordered_map<std::string, std::shared_ptr<DeltaState>> deltaStates;
+
+		DropStatistics dropStatistics;
+
+		// Which pipe of the direct socket belongs to which client and vice versa
+		std::unordered_map<std::string, uint32_t> clientPipes;
+		std::unordered_map<uint32_t, std::string> pipeClients;
+
+		// With SessionEncryptionStrategy: the session of the client behind each pipe
+		std::unordered_map<uint32_t, std::shared_ptr<SessionCipher>> pipeSessions;
+		std::mutex clientMutex;
+
+		std::thread directReceiveThread;
 		std::atomic<bool> isRunning;
 		std::atomic<bool> isStarted;
 
+		// Held shared by every emit while it uses the sockets, the crypto pool or the ordered senders,
+		// shutdown() takes it exclusively before tearing those down
+		std::shared_mutex emitMutex;
+
 		std::string url;
 
 		std::mutex shutdownMutex;
 	};
 
 
-	template<typename HandlerType>
-	void Server::on(const std::string& event, HandlerType handler)
+	template<typename Argument, typename HandlerType>
+	std::function<std::optional<nlohmann::json>(const Argument&)> Server::wrapHandler(HandlerType handler)
 	{
 		// get the return type of the passed lambda function
-		using ReturnType = std::invoke_result_t<HandlerType, const nlohmann::json&>;
+		using ReturnType = std::invoke_result_t<HandlerType, const Argument&>;
 
 		// idea here is to wrap the handler and always returning a optional json response on paper
 		// for handlers where the user doesnt return anything we return the null optional
-		auto wrappedHandler = [handler](const nlohmann::json& data) -> std::optional<nlohmann::json>
+		return [handler](const Argument& data) -> std::optional<nlohmann::json>
 		{
 
 			// figure out at compile time if the handler is a void
@@ -121,12 +351,63 @@ namespace EasyIPC
 				return handler(data);
 			}
 		};
+	}
 
+	template<typename HandlerType>
+	void Server::on(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
 		std::lock_guard<std::mutex> lock(handlerMutex);
 
 		// thanks to above approach all handlers follow same signature
 		// but when using this code they dont need to care about any of this
-		eventHandlers[event] = wrappedHandler;
+		eventHandlers[event] = { wrapHandler<nlohmann::json>(handler), nullptr, nullptr, nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	template<typename HandlerType>
+	void Server::onView(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		eventHandlers[event] = { nullptr, wrapHandler<DataView>(handler), nullptr, nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	template<typename HandlerType>
+	void Server::onArena(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		eventHandlers[event] = { nullptr, nullptr, wrapHandler<ArenaJson>(handler), nullptr };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	template<typename HandlerType>
+	void Server::onRaw(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+
+		eventHandlers[event] = { nullptr, nullptr, nullptr, wrapHandler<std::span<const std::byte>>(handler) };
+		if (priority)
+			eventPriorities[event] = *priority;
+	}
+
+	template<FixedLayout T, typename HandlerType>
+	void Server::onFixed(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
+		onRaw(event, [handler](std::span<const std::byte> bytes)
+		{
+			return handler(readFixed<T>(bytes));
+		}, priority);
+	}
+
+	template<typename HandlerType>
+	void Server::onAttachments(const std::string& event, HandlerType handler, std::optional<Priority> priority)
+	{
+		onRaw(event, readingAttachments(std::move(handler)), priority);
 	}
 }
 
@@ -0,0 +1,74 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	thread_local uint64_t allocations = 0;
+
+	void* allocate(size_t size)
+	{
+		++allocations;
+
+		// malloc(0) may return nullptr, new never does
+		if (void* memory = std::malloc(size ? size : 1))
+			return memory;
+
+		throw std::bad_alloc{};
+	}
+
+	void* allocateAligned(size_t size, std::align_val_t alignment)
+	{
+		++allocations;
+
+		size_t alignmentValue = static_cast<size_t>(alignment);
+		size = (size + alignmentValue - 1) / alignmentValue * alignmentValue;
+
+#ifdef _MSC_VER
+		void* memory = _aligned_malloc(size ? size : alignmentValue, alignmentValue);
+#else
+		void* memory = std::aligned_alloc(alignmentValue, size ? size : alignmentValue);
+#endif
+
+		if (memory)
+			return memory;
+
+		throw std::bad_alloc{};
+	}
+
+	void freeAligned(void* memory)
+	{
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+}
+
+namespace EasyIPCBench
+{
+	uint64_t allocationsOfThisThread()
+	{
+		return allocations;
+	}
+}
+
+// Replacing these in the executable replaces them for the whole process, including the statically linked library
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { try { return allocate(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return allocate(size); } catch (...) { return nullptr; } }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { freeAligned(memory); }
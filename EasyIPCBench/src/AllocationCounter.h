@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+namespace EasyIPCBench
+{
+	// Counts the heap allocations made by the calling thread, operator new is replaced in AllocationCounter.cpp.
+	// Only counts what goes through operator new, which is all of std::string, std::vector and cryptopp's SecBlock.
+	uint64_t allocationsOfThisThread();
+
+	// Allocations made by the calling thread while it is alive
+	class AllocationScope
+	{
+	public:
+		AllocationScope() : start{ allocationsOfThisThread() } {}
+
+		uint64_t count() const { return allocationsOfThisThread() - start; }
+
+	private:
+		uint64_t start;
+	};
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <exception>
+#include <nlohmann/json.hpp>
+
+namespace EasyIPCBench
+{
+	// Collects the failed checks of a verification, everything that went wrong ends up in "failures" by name
+	struct Checks
+	{
+		int trials = 0;
+		nlohmann::json failures = nlohmann::json::array();
+
+		// check has to return true without throwing
+		template<typename Check>
+		void expect(const std::string& name, Check&& check)
+		{
+			++trials;
+
+			try
+			{
+				if (!check())
+					failures.push_back(name);
+			}
+			catch (const std::exception& error)
+			{
+				failures.push_back(name + " threw: " + error.what());
+			}
+		}
+
+		template<typename Call>
+		void expectThrows(const std::string& name, Call&& call)
+		{
+			++trials;
+
+			try
+			{
+				call();
+				failures.push_back(name + " didnt throw");
+			}
+			catch (const std::exception&)
+			{
+			}
+		}
+
+		nlohmann::json result() const
+		{
+			return {
+				{"passed", failures.empty()},
+				{"trials", trials},
+				{"failures", failures}
+			};
+		}
+	};
+}
@@ -0,0 +1,348 @@
+#include "MessageBenchmark.h"
+#include "Checks.h"
+#include "Sampling.h"
+
+#include "Attachment.h"
+#include "DataView.h"
+#include "Envelope.h"
+#include "Framing.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace EasyIPCBench
+{
+	namespace
+	{
+		// A quote with as many order book levels as it takes to reach the payload size
+		std::string eventOfSize(size_t payloadSize)
+		{
+			std::string json = R"({"symbol":"EURUSD","price":1.0842,"levels":[)";
+			const std::string level = R"({"price":1.0842,"size":100})";
+
+			for (bool first = true; json.size() + level.size() + 2 < payloadSize; first = false)
+			{
+				if (!first)
+					json += ',';
+				json += level;
+			}
+
+			json += "]}";
+			return json;
+		}
+
+		std::string littleEndian(uint64_t value, size_t size)
+		{
+			std::string bytes;
+			for (size_t i = 0; i < size; ++i)
+			{
+				bytes.push_back(static_cast<char>(value >> (8 * i)));
+			}
+
+			return bytes;
+		}
+
+		std::span<const std::byte> bytesOf(std::string_view text)
+		{
+			return std::as_bytes(std::span{ text });
+		}
+
+		// Records the way sealBatch lays them out, each prefixed with its size
+		std::string batchOf(std::initializer_list<std::string_view> records)
+		{
+			std::string batch;
+			for (std::string_view record : records)
+			{
+				batch += littleEndian(record.size(), 4);
+				batch += record;
+			}
+
+			return batch;
+		}
+
+		nlohmann::json attachmentsOf(std::string_view data, std::vector<EasyIPC::Attachment>& attachments)
+		{
+			return EasyIPC::readAttachments(bytesOf(data), attachments);
+		}
+
+		size_t samplesFor(const BenchmarkOptions& options, size_t payloadSize)
+		{
+			return std::min(std::max<size_t>(options.bytesPerMeasurement / std::max<size_t>(payloadSize, 1), 16), options.maxLatencySamples);
+		}
+	}
+
+	nlohmann::json benchmarkParsing(const BenchmarkOptions& options)
+	{
+		nlohmann::json results = nlohmann::json::array();
+
+		for (size_t payloadSize : options.payloadSizes)
+		{
+			std::string json = eventOfSize(payloadSize);
+			size_t samples = samplesFor(options, json.size());
+
+			// summed up so the compiler cant drop the parsing
+			double prices = 0.0;
+			auto nothing = [] {};
+
+			results.push_back({
+				{"payloadBytes", json.size()},
+				{"dataView", sampleCalls(samples, nothing, [&]
+				{
+					// one document per message, like the client and server do
+					EasyIPC::DataView::Document document;
+					prices += document.parse(json)["price"].asDouble();
+				})},
+				{"json", sampleCalls(samples, nothing, [&]
+				{
+					prices += nlohmann::json::parse(json)["price"].get<double>();
+				})}
+			});
+		}
+
+		return results;
+	}
+
+	nlohmann::json benchmarkEnvelopes(const BenchmarkOptions& options)
+	{
+		nlohmann::json results = nlohmann::json::array();
+
+		for (size_t payloadSize : options.payloadSizes)
+		{
+			std::string json = eventOfSize(payloadSize);
+			nlohmann::json data = nlohmann::json::parse(json);
+			std::span<const std::byte> raw = std::as_bytes(std::span{ json });
+			std::string envelope = EasyIPC::writeEnvelope("quote", data);
+
+			size_t samples = samplesFor(options, json.size());
+
+			// summed up so the compiler cant drop the calls
+			size_t bytes = 0;
+			auto nothing = [] {};
+
+			// grows the thread buffer to the largest envelope first, from then on only the serializer allocates
+			bytes += EasyIPC::writeEnvelopeToThreadBuffer("quote", data).size();
+
+			results.push_back({
+				{"payloadBytes", json.size()},
+				{"writeJson", sampleCalls(samples, nothing, [&] { bytes += EasyIPC::writeEnvelopeToThreadBuffer("quote", data).size(); })},
+				{"writeRaw", sampleCalls(samples, nothing, [&] { bytes += EasyIPC::writeEnvelopeToThreadBuffer("quote", raw).size(); })},
+				{"read", sampleCalls(samples, nothing, [&] { bytes += EasyIPC::readEnvelope(envelope).parseData().size(); })}
+			});
+		}
+
+		return results;
+	}
+
+	nlohmann::json verifyParsing()
+	{
+		Checks check;
+
+		const std::string json = R"({"symbol":"EURUSD","price":1.0842,"volume":-250,"id":18446744073709551615,"open":true,"note":null,)"
+			R"("levels":[{"price":1.08,"size":100},{"price":1.09,"size":200}],"escaped":"a\"b\\c\u00e9","empty":{}})";
+
+		EasyIPC::DataView::Document document;
+		EasyIPC::DataView data = document.parse(json);
+
+#ifdef EASYIPC_USE_SIMDJSON
+		check.expect("library is built with EASYIPC_USE_SIMDJSON like the benchmark", [] { return EasyIPC::DataView::usesSimdjson(); });
+#else
+		check.expect("library is built without EASYIPC_USE_SIMDJSON like the benchmark", [] { return !EasyIPC::DataView::usesSimdjson(); });
+#endif
+
+		check.expect("string", [&] { return data["symbol"].isString() && data["symbol"].asString() == "EURUSD"; });
+		check.expect("double", [&] { return data["price"].isNumber() && data["price"].asDouble() == 1.0842; });
+		check.expect("negative integer", [&] { return data["volume"].asInt() == -250; });
+		check.expect("integer as double", [&] { return data["volume"].asDouble() == -250.0; });
+		check.expect("largest unsigned integer", [&] { return data["id"].asUint() == std::numeric_limits<uint64_t>::max(); });
+		check.expect("bool", [&] { return data["open"].isBool() && data["open"].asBool(); });
+		check.expect("null", [&] { return data["note"].exists() && data["note"].isNull(); });
+		check.expect("escaped string", [&] { return data["escaped"].asString() == "a\"b\\c\xc3\xa9"; });
+		check.expect("array", [&] { return data["levels"].isArray() && data["levels"].size() == 2; });
+		check.expect("nested value", [&] { return data["levels"][1]["size"].asInt() == 200; });
+		check.expect("empty object", [&] { return data["empty"].isObject() && data["empty"].size() == 0; });
+		check.expect("object size", [&] { return data.size() == 9; });
+		check.expect("size of a value", [&] { return data["price"].size() == 0; });
+		check.expect("missing key", [&] { return !data["missing"].exists() && !data["missing"].isNull(); });
+		check.expect("key of a missing key", [&] { return !data["missing"]["deeper"].exists(); });
+		check.expect("index past the end", [&] { return !data["levels"][2].exists(); });
+		check.expect("index of an object", [&] { return !data[size_t{ 0 }].exists(); });
+		check.expect("key of an array", [&] { return !data["levels"]["price"].exists(); });
+		check.expect("toJson", [&] { return data.toJson() == nlohmann::json::parse(json); });
+		check.expect("toJson of a missing key", [&] { return data["missing"].toJson().is_null(); });
+
+		check.expect("document parsed while another one is alive", [&]
+		{
+			EasyIPC::DataView::Document inner;
+			EasyIPC::DataView other = inner.parse(R"({"symbol":"GBPUSD"})");
+			return other["symbol"].asString() == "GBPUSD" && data["symbol"].asString() == "EURUSD";
+		});
+
+		check.expectThrows("string as integer", [&] { data["symbol"].asInt(); });
+		check.expectThrows("double as bool", [&] { data["price"].asBool(); });
+		check.expectThrows("negative integer as unsigned", [&] { data["volume"].asUint(); });
+		check.expectThrows("double as integer", [&] { data["price"].asInt(); });
+		check.expectThrows("largest unsigned integer as integer", [&] { data["id"].asInt(); });
+		check.expectThrows("missing key as string", [&] { data["missing"].asString(); });
+		check.expectThrows("object as string", [&] { data["empty"].asString(); });
+
+		for (const char* invalid : { "", "{", R"({"price":)", R"({"price":1.0842,})", "[1,2", R"({"symbol":"EURUSD)", "nope" })
+		{
+			check.expectThrows("invalid json " + std::string(invalid), [&]
+			{
+				EasyIPC::DataView::Document broken;
+				broken.parse(invalid);
+			});
+		}
+
+		return check.result();
+	}
+
+	nlohmann::json verifyFraming()
+	{
+		Checks check;
+
+		// batches, see splitBatch
+		check.expect("empty batch", [] { return EasyIPC::splitBatch({}).empty(); });
+		check.expect("batch round trip", []
+		{
+			return EasyIPC::splitBatch(batchOf({ "first", "", "third" })) == std::vector<std::string_view>{ "first", "", "third" };
+		});
+
+		const std::string batch = batchOf({ "first", "second" });
+		const size_t firstRecordEnd = 4 + 5;
+
+		check.expect("batch cut right behind a record", [&] { return EasyIPC::splitBatch(std::string_view{ batch }.substr(0, firstRecordEnd)).size() == 1; });
+
+		for (size_t size = 1; size < batch.size(); ++size)
+		{
+			if (size == firstRecordEnd)
+				continue;
+
+			check.expectThrows("batch truncated to " + std::to_string(size) + " bytes", [&] { EasyIPC::splitBatch(std::string_view{ batch }.substr(0, size)); });
+		}
+
+		check.expectThrows("batch record one byte larger than the batch", [] { EasyIPC::splitBatch(littleEndian(4, 4) + "abc"); });
+		check.expectThrows("batch record of 4 GB", [] { EasyIPC::splitBatch(littleEndian(0xFFFFFFFF, 4) + "abc"); });
+
+		// envelopes, see readEnvelope
+		const nlohmann::json data = { {"price", 1.0842}, {"symbol", "EURUSD"} };
+		const std::string envelope = EasyIPC::writeEnvelope("quote", data, 42, EasyIPC::EnvelopeKind::Keyframe);
+		const size_t headerSize = 2 + 5 + 8 + 1;
+
+		check.expect("envelope round trip", [&]
+		{
+			EasyIPC::Envelope read = EasyIPC::readEnvelope(envelope);
+			return read.event == "quote" && read.sequence == 42 && read.kind == EasyIPC::EnvelopeKind::Keyframe && read.parseData() == data;
+		});
+
+		check.expect("envelope without event name and data", []
+		{
+			std::string written = EasyIPC::writeEnvelope("", nlohmann::json{});
+			EasyIPC::Envelope read = EasyIPC::readEnvelope(written);
+			return written.size() == 2 + 8 + 1 && read.event.empty() && read.data.empty() && read.parseData().is_null();
+		});
+
+		check.expect("raw envelope round trip", []
+		{
+			const std::string raw("\0\1\2\3", 4);
+			std::string written = EasyIPC::writeEnvelope("raw", bytesOf(raw), 7);
+			EasyIPC::Envelope read = EasyIPC::readEnvelope(written);
+			return read.event == "raw" && read.sequence == 7 && read.kind == EasyIPC::EnvelopeKind::Value && std::ranges::equal(read.rawData(), bytesOf(raw));
+		});
+
+		check.expect("longest event name", []
+		{
+			std::string event(0xFFFF, 'e');
+			return EasyIPC::readEnvelope(EasyIPC::writeEnvelope(event, nlohmann::json{})).event == event;
+		});
+
+		check.expectThrows("event name too long to write", [] { EasyIPC::writeEnvelope(std::string(0x10000, 'e'), nlohmann::json{}); });
+
+		for (size_t size = 0; size < headerSize; ++size)
+		{
+			check.expectThrows("envelope truncated to " + std::to_string(size) + " bytes", [&] { EasyIPC::readEnvelope(std::string_view{ envelope }.substr(0, size)); });
+		}
+
+		check.expectThrows("event name larger than the envelope", [&]
+		{
+			std::string broken = envelope;
+			broken[0] = broken[1] = '\xFF';
+			EasyIPC::readEnvelope(broken);
+		});
+
+		for (char kind : { '\x03', '\xFF' })
+		{
+			check.expectThrows("envelope of unknown kind " + std::to_string(static_cast<uint8_t>(kind)), [&]
+			{
+				std::string broken = envelope;
+				broken[headerSize - 1] = kind;
+				EasyIPC::readEnvelope(broken);
+			});
+		}
+
+		check.expectThrows("envelope with malformed json", []
+		{
+			EasyIPC::readEnvelope(EasyIPC::writeEnvelope("quote", bytesOf(R"({"price":)"))).parseData();
+		});
+
+		// attachments, see readAttachments
+		const nlohmann::json metadata = { {"rate", 48000} };
+		const std::string first(3, 'a');
+		const std::string second(40, 'b');
+		const std::vector<std::span<const std::byte>> attached = { {}, bytesOf(first), bytesOf(second) };
+		const std::string withAttachments{ EasyIPC::readEnvelope(EasyIPC::writeEnvelope("samples", EasyIPC::AttachedData{ metadata, attached, 1 })).data };
+
+		check.expect("attachments round trip", [&]
+		{
+			std::vector<EasyIPC::Attachment> attachments;
+			return attachmentsOf(withAttachments, attachments) == metadata && attachments.size() == 3 && attachments[0].size() == 0
+				&& std::ranges::equal(attachments[1].bytes(), bytesOf(first)) && std::ranges::equal(attachments[2].bytes(), bytesOf(second));
+		});
+
+		check.expect("no metadata and no attachments", []
+		{
+			// filled before, readAttachments has to clear it
+			std::vector<EasyIPC::Attachment> attachments;
+			attachments.emplace_back(std::span<const std::byte>{});
+			return attachmentsOf(littleEndian(0, 4) + littleEndian(0, 4) + '\0', attachments).is_null() && attachments.empty();
+		});
+
+		for (size_t size = 0; size < withAttachments.size(); ++size)
+		{
+			check.expectThrows("attachments truncated to " + std::to_string(size) + " bytes", [&]
+			{
+				std::vector<EasyIPC::Attachment> attachments;
+				attachmentsOf(std::string_view{ withAttachments }.substr(0, size), attachments);
+			});
+		}
+
+		const std::vector<std::pair<std::string, std::string>> brokenAttachments = {
+			{ "metadata larger than the message", littleEndian(1000, 4) + "{}" + littleEndian(0, 4) + '\0' },
+			{ "4 billion attachments", littleEndian(0, 4) + littleEndian(0xFFFFFFFF, 4) + '\0' },
+			{ "attachment larger than the message", littleEndian(0, 4) + littleEndian(1, 4) + littleEndian(4, 8) + '\0' + "abc" },
+			{ "attachment of 16 EB", littleEndian(0, 4) + littleEndian(1, 4) + littleEndian(std::numeric_limits<uint64_t>::max(), 8) + '\0' + "abc" },
+			{ "padding of a whole alignment", littleEndian(0, 4) + littleEndian(0, 4) + '\x10' + std::string(16, '\0') },
+			{ "padding larger than the message", littleEndian(0, 4) + littleEndian(0, 4) + '\x05' + "ab" },
+			{ "malformed metadata", littleEndian(8, 4) + R"({"rate":)" + littleEndian(0, 4) + '\0' }
+		};
+
+		for (const auto& [name, broken] : brokenAttachments)
+		{
+			check.expectThrows(name, [&]
+			{
+				std::vector<EasyIPC::Attachment> attachments;
+				attachmentsOf(broken, attachments);
+			});
+		}
+
+		return check.result();
+	}
+}
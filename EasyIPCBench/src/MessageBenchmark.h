@@ -0,0 +1,24 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include "StrategyBenchmark.h"
+
+namespace EasyIPCBench
+{
+	// Latency and allocations per call of parsing an event of each payload size with DataView (onView handlers)
+	// and with nlohmann::json (on handlers), single thread, with whichever parser the library was built with
+	nlohmann::json benchmarkParsing(const BenchmarkOptions& options);
+
+	// Latency and allocations per call of writing an event of each payload size into the thread buffer, as json and as raw bytes,
+	// and of reading it back and parsing its data, single thread
+	nlohmann::json benchmarkEnvelopes(const BenchmarkOptions& options);
+
+	// Reads values of every type through a DataView and compares them with nlohmann::json, looks up what isnt there,
+	// reads values as the wrong type and parses invalid json. "passed" is false if anything gave the wrong result.
+	nlohmann::json verifyParsing();
+
+	// Splits batches, reads envelopes and attachments that are truncated at every byte, claim to be larger than they are
+	// or are broken otherwise, all of those have to throw. Well formed ones have to come back as they were written.
+	nlohmann::json verifyFraming();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "AllocationCounter.h"
+
+namespace EasyIPCBench
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Times every call on its own, prepare runs before each call without being timed.
+	// The result are the percentiles in nanoseconds plus the allocations per call.
+	template<typename Prepare, typename Call>
+	nlohmann::json sampleCalls(size_t samples, Prepare&& prepare, Call&& call)
+	{
+		std::vector<double> latencies;
+		latencies.reserve(samples);
+
+		uint64_t allocations = 0;
+
+		for (size_t i = 0; i < samples; ++i)
+		{
+			prepare();
+
+			AllocationScope scope;
+			auto start = Clock::now();
+			call();
+			auto end = Clock::now();
+
+			// the vector is reserved, so this doesnt allocate
+			allocations += scope.count();
+			latencies.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+
+		auto percentile = [&latencies](double fraction)
+		{
+			return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))];
+		};
+
+		return {
+			{"samples", samples},
+			{"minNs", latencies.front()},
+			{"medianNs", percentile(0.5)},
+			{"p99Ns", percentile(0.99)},
+			{"maxNs", latencies.back()},
+			{"allocationsPerCall", static_cast<double>(allocations) / samples}
+		};
+	}
+}
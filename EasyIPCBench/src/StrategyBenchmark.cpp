@@ -0,0 +1,387 @@
+#include "StrategyBenchmark.h"
+#include "Checks.h"
+#include "Sampling.h"
+
+#include "Encryption/InPlaceEncryptionStrategy.h"
+#include "Encryption/ReplayWindow.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+namespace EasyIPCBench
+{
+	namespace
+	{
+		size_t iterationsFor(const BenchmarkOptions& options, size_t payloadSize)
+		{
+			return std::max<size_t>(options.bytesPerMeasurement / std::max<size_t>(payloadSize, 1), 16);
+		}
+
+		nlohmann::json measureStringInterface(EasyIPC::EncryptionStrategy& strategy, size_t payloadSize, size_t samples)
+		{
+			std::string payload(payloadSize, 'x');
+			std::string cipherText = strategy.encrypt(payload);
+			std::string plainText;
+
+			auto nothing = [] {};
+
+			return {
+				{"encrypt", sampleCalls(samples, nothing, [&] { cipherText = strategy.encrypt(payload); })},
+				{"decrypt", sampleCalls(samples, nothing, [&] { plainText = strategy.decrypt(cipherText); })}
+			};
+		}
+
+		nlohmann::json measureInPlaceInterface(EasyIPC::InPlaceEncryptionStrategy& strategy, size_t payloadSize, size_t samples)
+		{
+			std::vector<uint8_t> buffer(strategy.headroom() + payloadSize + strategy.tailroom(), 'x');
+
+			// sealing encrypts whatever is in the buffer, that it is ciphertext after the first round doesnt matter for timing
+			nlohmann::json seal = sampleCalls(samples, [] {}, [&] { strategy.seal(buffer, {}); });
+
+			// opening destroys the ciphertext, so every round opens a fresh copy
+			std::vector<uint8_t> sealed = buffer;
+			nlohmann::json open = sampleCalls(samples,
+				[&] { std::memcpy(buffer.data(), sealed.data(), sealed.size()); },
+				[&] { strategy.open(buffer, {}); });
+
+			return {
+				{"seal", seal},
+				{"open", open}
+			};
+		}
+
+		// Runs work on every thread at the same time, returns how long it took until all of them were done
+		template<typename Work>
+		double runConcurrently(size_t threadCount, Work&& work)
+		{
+			std::atomic<size_t> ready{ 0 };
+			std::atomic<bool> go{ false };
+			std::vector<std::thread> threads;
+
+			for (size_t thread = 0; thread < threadCount; ++thread)
+			{
+				threads.emplace_back([&, thread]
+				{
+					++ready;
+					while (!go)
+						std::this_thread::yield();
+
+					work(thread);
+				});
+			}
+
+			while (ready < threadCount)
+				std::this_thread::yield();
+
+			auto start = Clock::now();
+			go = true;
+
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		nlohmann::json measureThroughput(EasyIPC::EncryptionStrategy& strategy, size_t payloadSize, size_t threadCount, size_t iterations)
+		{
+			size_t iterationsPerThread = std::max<size_t>(iterations / threadCount, 1);
+
+			// every thread works on its own strings, only the strategy is shared
+			std::vector<std::string> payloads(threadCount, std::string(payloadSize, 'x'));
+			std::vector<std::string> cipherTexts(threadCount);
+
+			for (size_t thread = 0; thread < threadCount; ++thread)
+			{
+				cipherTexts[thread] = strategy.encrypt(payloads[thread]);
+			}
+
+			double encryptSeconds = runConcurrently(threadCount, [&](size_t thread)
+			{
+				for (size_t i = 0; i < iterationsPerThread; ++i)
+				{
+					cipherTexts[thread] = strategy.encrypt(payloads[thread]);
+				}
+			});
+
+			double decryptSeconds = runConcurrently(threadCount, [&](size_t thread)
+			{
+				for (size_t i = 0; i < iterationsPerThread; ++i)
+				{
+					payloads[thread] = strategy.decrypt(cipherTexts[thread]);
+				}
+			});
+
+			double totalBytes = static_cast<double>(payloadSize) * iterationsPerThread * threadCount;
+			double totalCalls = static_cast<double>(iterationsPerThread) * threadCount;
+
+			return {
+				{"threads", threadCount},
+				{"encryptGBps", totalBytes / encryptSeconds / 1e9},
+				{"decryptGBps", totalBytes / decryptSeconds / 1e9},
+				{"encryptCallsPerSecond", totalCalls / encryptSeconds},
+				{"decryptCallsPerSecond", totalCalls / decryptSeconds}
+			};
+		}
+
+		struct TamperCheck
+		{
+			std::atomic<int> callbacks{ 0 };
+			int trials = 0;
+			int rejected = 0;
+			int calledBack = 0;
+			nlohmann::json failures = nlohmann::json::array();
+
+			// attack has to throw and make the strategy call the compromised callback
+			template<typename Attack>
+			void expectRejected(const std::string& name, Attack&& attack)
+			{
+				++trials;
+				int callbacksBefore = callbacks;
+				bool threw = false;
+
+				try
+				{
+					attack();
+				}
+				catch (const std::exception&)
+				{
+					threw = true;
+				}
+
+				bool compromised = callbacks > callbacksBefore;
+
+				if (threw)
+					++rejected;
+				if (compromised)
+					++calledBack;
+
+				if (!threw || !compromised)
+				{
+					failures.push_back({ {"case", name}, {"threw", threw}, {"calledBack", compromised} });
+				}
+			}
+		};
+	}
+
+	nlohmann::json benchmark(const StrategyUnderTest& strategy, const BenchmarkOptions& options)
+	{
+		nlohmann::json results = nlohmann::json::array();
+
+		for (size_t payloadSize : options.payloadSizes)
+		{
+			std::shared_ptr<EasyIPC::EncryptionStrategy> instance = strategy.create();
+			size_t iterations = iterationsFor(options, payloadSize);
+			size_t samples = std::min(iterations, options.maxLatencySamples);
+
+			nlohmann::json result = {
+				{"payloadBytes", payloadSize},
+				{"string", measureStringInterface(*instance, payloadSize, samples)}
+			};
+
+			if (auto* inPlace = dynamic_cast<EasyIPC::InPlaceEncryptionStrategy*>(instance.get()))
+			{
+				result["inPlace"] = measureInPlaceInterface(*inPlace, payloadSize, samples);
+			}
+
+			nlohmann::json throughput = nlohmann::json::array();
+			for (size_t threadCount : options.threadCounts)
+			{
+				throughput.push_back(measureThroughput(*instance, payloadSize, threadCount, iterations));
+			}
+
+			result["throughput"] = throughput;
+			results.push_back(result);
+		}
+
+		return results;
+	}
+
+	nlohmann::json verify(const StrategyUnderTest& strategy)
+	{
+		std::shared_ptr<EasyIPC::EncryptionStrategy> instance = strategy.create();
+		auto* inPlace = dynamic_cast<EasyIPC::InPlaceEncryptionStrategy*>(instance.get());
+
+		TamperCheck check;
+		instance->setOnCompromisedHandler([&check] { ++check.callbacks; });
+
+		bool roundTrips = true;
+
+		for (size_t payloadSize : { 0ull, 1ull, 32ull, 4096ull })
+		{
+			std::string payload(payloadSize, '\0');
+			for (size_t i = 0; i < payloadSize; ++i)
+			{
+				payload[i] = static_cast<char>(i * 31 + 7);
+			}
+
+			// every attack gets its own message, otherwise counter nonces would reject them as replays anyway
+			auto freshMessage = [&] { return instance->encrypt(payload); };
+
+			int callbacksBefore = check.callbacks;
+			roundTrips = roundTrips && instance->decrypt(freshMessage()) == payload && check.callbacks == callbacksBefore;
+
+			if (!strategy.authenticates)
+				continue;
+
+			std::string size = std::to_string(payloadSize);
+			size_t messageSize = freshMessage().size();
+
+			for (size_t position : { size_t{ 0 }, messageSize / 2, messageSize - 1 })
+			{
+				check.expectRejected("flipped bit at " + std::to_string(position) + " of " + size + " byte payload", [&]
+				{
+					std::string message = freshMessage();
+					message[position] ^= 0x01;
+					instance->decrypt(message);
+				});
+			}
+
+			check.expectRejected("truncated " + size + " byte payload", [&]
+			{
+				std::string message = freshMessage();
+				message.pop_back();
+				instance->decrypt(message);
+			});
+
+			check.expectRejected("appended byte to " + size + " byte payload", [&]
+			{
+				instance->decrypt(freshMessage() + '\0');
+			});
+
+			check.expectRejected("empty message", [&] { instance->decrypt(std::string{}); });
+
+			if (inPlace)
+			{
+				check.expectRejected("changed associated data of " + size + " byte payload", [&]
+				{
+					std::vector<uint8_t> buffer(inPlace->headroom() + payloadSize + inPlace->tailroom());
+					std::memcpy(buffer.data() + inPlace->headroom(), payload.data(), payloadSize);
+
+					uint8_t associatedData[] = { 1, 2, 3 };
+					inPlace->seal(buffer, associatedData);
+
+					associatedData[2] = 4;
+					inPlace->open(buffer, associatedData);
+				});
+			}
+
+			if (strategy.rejectsReplays)
+			{
+				check.expectRejected("replayed " + size + " byte payload", [&]
+				{
+					std::string message = freshMessage();
+					instance->decrypt(message);
+					instance->decrypt(message);
+				});
+			}
+		}
+
+		bool passed = roundTrips && check.failures.empty();
+
+		return {
+			{"passed", passed},
+			{"roundTrips", roundTrips},
+			{"authenticates", strategy.authenticates},
+			{"trials", check.trials},
+			{"rejected", check.rejected},
+			{"calledBack", check.calledBack},
+			{"failures", check.failures}
+		};
+	}
+
+	nlohmann::json verifyReplayWindow()
+	{
+		using EasyIPC::NonceCheck;
+		using EasyIPC::ReplayWindow;
+
+		Checks check;
+
+		// size is 128, the window reaches from highest - 127 up to highest
+		auto windowAt = [](uint64_t highest)
+		{
+			ReplayWindow window{ 128 };
+			window.accept(highest);
+			return window;
+		};
+
+		check.expect("first counter", [] { ReplayWindow window{ 128 }; return window.accept(0) == NonceCheck::Accepted; });
+		check.expect("duplicate of the first counter", [] { ReplayWindow window{ 128 }; window.accept(0); return window.accept(0) == NonceCheck::Replayed; });
+		check.expect("duplicate of the highest counter", [&] { return windowAt(1000).accept(1000) == NonceCheck::Replayed; });
+		check.expect("counter == highest - size", [&] { return windowAt(1000).accept(1000 - 128) == NonceCheck::TooOld; });
+		check.expect("counter == highest - size + 1", [&] { return windowAt(1000).accept(1000 - 127) == NonceCheck::Accepted; });
+
+		check.expect("duplicate at the oldest edge", [&]
+		{
+			ReplayWindow window = windowAt(1000);
+			return window.accept(1000 - 127) == NonceCheck::Accepted && window.accept(1000 - 127) == NonceCheck::Replayed;
+		});
+
+		check.expect("out of order within the window", [&]
+		{
+			ReplayWindow window = windowAt(1000);
+			return window.accept(999) == NonceCheck::Accepted && window.accept(950) == NonceCheck::Accepted
+				&& window.accept(999) == NonceCheck::Replayed && window.getHighest() == 1000;
+		});
+
+		check.expect("jump of exactly the window", [&]
+		{
+			ReplayWindow window = windowAt(1000);
+			return window.accept(1000 + 128) == NonceCheck::Accepted && window.accept(1000) == NonceCheck::TooOld
+				&& window.accept(1001) == NonceCheck::Accepted;
+		});
+
+		check.expect("jump larger than the window", [&]
+		{
+			ReplayWindow window = windowAt(1000);
+			return window.accept(1000 + 10 * 128) == NonceCheck::Accepted && window.accept(1000) == NonceCheck::TooOld
+				&& window.accept(1000 + 9 * 128 + 1) == NonceCheck::Accepted && window.getHighest() == 1000 + 10 * 128;
+		});
+
+		check.expect("counter in a reused block of the ring", []
+		{
+			// the ring has 3 blocks of 64, counter 5 and 5 + 3 * 64 share one
+			ReplayWindow window{ 128 };
+			return window.accept(5) == NonceCheck::Accepted && window.accept(5 + 3 * 64) == NonceCheck::Accepted
+				&& window.accept(5) == NonceCheck::TooOld && window.accept(5 + 2 * 64) == NonceCheck::Accepted;
+		});
+
+		check.expect("size rounded up to 64", []
+		{
+			ReplayWindow window{ 100 };
+			window.accept(1000);
+			return window.accept(1000 - 127) == NonceCheck::Accepted && window.accept(1000 - 128) == NonceCheck::TooOld;
+		});
+
+		check.expect("size 0", []
+		{
+			ReplayWindow window{ 0 };
+			window.accept(1000);
+			return window.accept(1000 - 63) == NonceCheck::Accepted && window.accept(1000 - 64) == NonceCheck::TooOld;
+		});
+
+		check.expect("counters at the end of the range", []
+		{
+			constexpr uint64_t last = std::numeric_limits<uint64_t>::max();
+			ReplayWindow window{ 128 };
+			return window.accept(last - 1) == NonceCheck::Accepted && window.accept(last) == NonceCheck::Accepted
+				&& window.accept(last - 1) == NonceCheck::Replayed && window.accept(last - 128) == NonceCheck::TooOld;
+		});
+
+		check.expect("resumed sender", []
+		{
+			ReplayWindow window{ 128 };
+			window.resumeAfter(500);
+			return window.accept(500) == NonceCheck::TooOld && window.accept(400) == NonceCheck::TooOld
+				&& window.accept(502) == NonceCheck::Accepted && window.accept(501) == NonceCheck::Accepted
+				&& window.accept(501) == NonceCheck::Replayed && window.getHighest() == 502;
+		});
+
+		return check.result();
+	}
+}
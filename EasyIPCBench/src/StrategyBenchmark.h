@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <nlohmann/json.hpp>
+
+#include "Encryption/EncryptionStrategy.h"
+
+namespace EasyIPCBench
+{
+	struct StrategyUnderTest
+	{
+		std::string name;
+
+		// Every measurement gets a fresh instance, so callbacks and nonce state dont leak between them
+		std::function<std::shared_ptr<EasyIPC::EncryptionStrategy>()> create;
+
+		// False for strategies that dont authenticate (NoEncryptionStrategy), tampering then isnt expected to be detected
+		bool authenticates = true;
+
+		// Counter nonces reject the same ciphertext the second time, so they are only verified and not benchmarked
+		// (the decrypt benchmark decrypts the same message over and over)
+		bool rejectsReplays = false;
+	};
+
+	struct BenchmarkOptions
+	{
+		std::vector<size_t> payloadSizes;
+		std::vector<size_t> threadCounts;
+
+		// Each measurement pushes about this many bytes through the strategy, so small payloads get enough iterations
+		size_t bytesPerMeasurement = 256ull * 1024 * 1024;
+
+		// Calls that are timed one by one for the latency percentiles
+		size_t maxLatencySamples = 20000;
+	};
+
+	// Latency and allocations per call (single thread, string and in place interface) and throughput with each thread count,
+	// all threads share one instance like the server's crypto workers do
+	nlohmann::json benchmark(const StrategyUnderTest& strategy, const BenchmarkOptions& options);
+
+	// Flips bits, truncates messages, changes associated data and replays messages, every one of those has to be rejected
+	// with an exception AND a call of the compromised callback. "passed" is false if anything slipped through.
+	nlohmann::json verify(const StrategyUnderTest& strategy);
+
+	// Counters at both edges of the window, jumps further than the window, duplicates and resumed senders,
+	// each has to come out as accepted, too old or replayed exactly like ReplayWindow documents it
+	nlohmann::json verifyReplayWindow();
+}
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "MessageBenchmark.h"
+#include "StrategyBenchmark.h"
+
+#include "DataView.h"
+#include "Encryption/AesEaxEncryptionStrategy.h"
+#include "Encryption/AesGcmEncryptionStrategy.h"
+#include "Encryption/AutoAeadEncryptionStrategy.h"
+#include "Encryption/ChaCha20Poly1305EncryptionStrategy.h"
+#include "Encryption/NoEncryptionStrategy.h"
+
+namespace
+{
+	const std::string hexKey = "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4";
+
+	template<typename Strategy, typename... Arguments>
+	std::function<std::shared_ptr<EasyIPC::EncryptionStrategy>()> factory(Arguments... arguments)
+	{
+		return [=] { return std::make_shared<Strategy>(arguments...); };
+	}
+
+	// Add your own strategies here to compare them with the provided ones
+	std::vector<EasyIPCBench::StrategyUnderTest> strategies()
+	{
+		using namespace EasyIPC;
+
+		return {
+			{ "none", factory<NoEncryptionStrategy>(), false },
+			{ "aes-eax", factory<AesEaxEncryptionStrategy>(hexKey) },
+			{ "aes-gcm", factory<AesGcmEncryptionStrategy>(hexKey) },
+			{ "chacha20-poly1305", factory<ChaCha20Poly1305EncryptionStrategy>(hexKey) },
+			{ "auto-aead", factory<AutoAeadEncryptionStrategy>(hexKey) },
+			{ "aes-eax-counter", factory<AesEaxEncryptionStrategy>(hexKey, NonceMode::Counter), true, true },
+			{ "aes-gcm-counter", factory<AesGcmEncryptionStrategy>(hexKey, NonceMode::Counter), true, true },
+			{ "chacha20-poly1305-counter", factory<ChaCha20Poly1305EncryptionStrategy>(hexKey, NonceMode::Counter), true, true }
+		};
+	}
+
+	void printUsage()
+	{
+		std::cerr <<
+			"Usage: EasyIPCBench [--json <file>] [--quick] [--max-threads <n>] [--only <strategy>] [--verify-only]\n"
+			"  --json         write all results as json to the file, - for stdout\n"
+			"  --quick        fewer payload sizes and less data per measurement, e.g. for CI\n"
+			"  --max-threads  measure throughput with 1, 2, 4 ... up to n threads (default: hardware threads)\n"
+			"  --only         only run the strategy with this name, dataview, envelope, framing or replay-window\n"
+			"  --verify-only  skip the benchmarks, only check that tampered and malformed messages are rejected and DataView reads what nlohmann reads\n";
+	}
+
+	std::string timestamp()
+	{
+		std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+		std::tm utc{};
+#ifdef _MSC_VER
+		gmtime_s(&utc, &now);
+#else
+		gmtime_r(&now, &utc);
+#endif
+
+		char buffer[32];
+		std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+		return buffer;
+	}
+
+	// One line per payload size: median latencies and the throughput with the most threads
+	void printSummary(const std::string& name, const nlohmann::json& results)
+	{
+		std::fprintf(stderr, "\n%s\n", name.c_str());
+		std::fprintf(stderr, "%10s | %12s %12s %8s | %12s %12s | %8s %12s %12s\n",
+			"payload", "enc med ns", "dec med ns", "allocs", "seal med ns", "open med ns", "threads", "enc GB/s", "dec GB/s");
+
+		for (const nlohmann::json& result : results)
+		{
+			const nlohmann::json& string = result["string"];
+			const nlohmann::json& throughput = result["throughput"].back();
+
+			double sealNs = result.contains("inPlace") ? result["inPlace"]["seal"]["medianNs"].get<double>() : 0.0;
+			double openNs = result.contains("inPlace") ? result["inPlace"]["open"]["medianNs"].get<double>() : 0.0;
+
+			std::fprintf(stderr, "%10zu | %12.0f %12.0f %8.1f | %12.0f %12.0f | %8zu %12.3f %12.3f\n",
+				result["payloadBytes"].get<size_t>(),
+				string["encrypt"]["medianNs"].get<double>(), string["decrypt"]["medianNs"].get<double>(),
+				string["encrypt"]["allocationsPerCall"].get<double>() + string["decrypt"]["allocationsPerCall"].get<double>(),
+				sealNs, openNs,
+				throughput["threads"].get<size_t>(), throughput["encryptGBps"].get<double>(), throughput["decryptGBps"].get<double>());
+		}
+	}
+
+	void printEnvelopeSummary(const nlohmann::json& results)
+	{
+		std::fprintf(stderr, "\nenvelope\n");
+		std::fprintf(stderr, "%10s | %12s %8s | %12s %8s | %12s %8s\n", "payload", "json med ns", "allocs", "raw med ns", "allocs", "read med ns", "allocs");
+
+		for (const nlohmann::json& result : results)
+		{
+			std::fprintf(stderr, "%10zu | %12.0f %8.1f | %12.0f %8.1f | %12.0f %8.1f\n",
+				result["payloadBytes"].get<size_t>(),
+				result["writeJson"]["medianNs"].get<double>(), result["writeJson"]["allocationsPerCall"].get<double>(),
+				result["writeRaw"]["medianNs"].get<double>(), result["writeRaw"]["allocationsPerCall"].get<double>(),
+				result["read"]["medianNs"].get<double>(), result["read"]["allocationsPerCall"].get<double>());
+		}
+	}
+
+	void printParsingSummary(const nlohmann::json& results)
+	{
+		std::fprintf(stderr, "\ndataview (%s)\n", EasyIPC::DataView::usesSimdjson() ? "simdjson" : "nlohmann");
+		std::fprintf(stderr, "%10s | %12s %8s | %12s %8s\n", "payload", "view med ns", "allocs", "json med ns", "allocs");
+
+		for (const nlohmann::json& result : results)
+		{
+			std::fprintf(stderr, "%10zu | %12.0f %8.1f | %12.0f %8.1f\n",
+				result["payloadBytes"].get<size_t>(),
+				result["dataView"]["medianNs"].get<double>(), result["dataView"]["allocationsPerCall"].get<double>(),
+				result["json"]["medianNs"].get<double>(), result["json"]["allocationsPerCall"].get<double>());
+		}
+	}
+}
+
+// Benchmarks and verifies the encryption strategies, run the Release build.
+// Exits with 1 if any strategy let a tampered message through, a malformed message was read or DataView read something wrong,
+// so it can run as a check in CI.
+int main(int argc, char** argv)
+{
+	std::string jsonPath;
+	std::string only;
+	bool quick = false;
+	bool verifyOnly = false;
+	size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (argument == "--json" && hasValue)
+			jsonPath = argv[++i];
+		else if (argument == "--only" && hasValue)
+			only = argv[++i];
+		else if (argument == "--max-threads" && hasValue)
+			maxThreads = std::max(1, std::atoi(argv[++i]));
+		else if (argument == "--quick")
+			quick = true;
+		else if (argument == "--verify-only")
+			verifyOnly = true;
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	EasyIPCBench::BenchmarkOptions options;
+
+	if (quick)
+	{
+		options.payloadSizes = { 32, 1024, 64 * 1024, 1024 * 1024 };
+		options.bytesPerMeasurement = 16ull * 1024 * 1024;
+		options.maxLatencySamples = 2000;
+	}
+	else
+	{
+		options.payloadSizes = { 32, 256, 1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 };
+	}
+
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		options.threadCounts.push_back(threads);
+	}
+
+	if (options.threadCounts.back() != maxThreads)
+	{
+		options.threadCounts.push_back(maxThreads);
+	}
+
+#ifdef NDEBUG
+	const char* build = "release";
+#else
+	const char* build = "debug";
+	std::fprintf(stderr, "This is a debug build, the numbers are meaningless.\n");
+#endif
+
+	nlohmann::json report = {
+		{"timestamp", timestamp()},
+		{"build", build},
+		{"hardwareThreads", std::thread::hardware_concurrency()},
+		{"aesHardwareAccelerated", EasyIPC::AesGcmEncryptionStrategy::isHardwareAccelerated()},
+		{"fastestAead", EasyIPC::AutoAeadEncryptionStrategy::fastestAvailable() == EasyIPC::AeadAlgorithm::AesGcm ? "aes-gcm" : "chacha20-poly1305"},
+		{"bytesPerMeasurement", options.bytesPerMeasurement},
+		{"strategies", nlohmann::json::array()}
+	};
+
+	bool allPassed = true;
+
+	for (const EasyIPCBench::StrategyUnderTest& strategy : strategies())
+	{
+		if (!only.empty() && strategy.name != only)
+			continue;
+
+		nlohmann::json entry = {
+			{"name", strategy.name},
+			{"verification", EasyIPCBench::verify(strategy)}
+		};
+
+		bool passed = entry["verification"]["passed"];
+		allPassed = allPassed && passed;
+
+		std::fprintf(stderr, "%-28s verification %s (%d/%d tampered messages rejected)\n", strategy.name.c_str(), passed ? "passed" : "FAILED",
+			entry["verification"]["rejected"].get<int>(), entry["verification"]["trials"].get<int>());
+
+		if (!verifyOnly && !strategy.rejectsReplays)
+		{
+			entry["results"] = EasyIPCBench::benchmark(strategy, options);
+			printSummary(strategy.name, entry["results"]);
+		}
+
+		report["strategies"].push_back(entry);
+	}
+
+	if (only.empty() || only == "dataview")
+	{
+		nlohmann::json parsing = {
+			{"parser", EasyIPC::DataView::usesSimdjson() ? "simdjson" : "nlohmann"},
+			{"verification", EasyIPCBench::verifyParsing()}
+		};
+
+		bool passed = parsing["verification"]["passed"];
+		allPassed = allPassed && passed;
+
+		std::fprintf(stderr, "%-28s verification %s (%d checks)\n", "dataview", passed ? "passed" : "FAILED",
+			parsing["verification"]["trials"].get<int>());
+
+		if (!verifyOnly)
+		{
+			parsing["results"] = EasyIPCBench::benchmarkParsing(options);
+			printParsingSummary(parsing["results"]);
+		}
+
+		report["parsing"] = parsing;
+	}
+
+	// checks of the parsers and the replay window, without a benchmark
+	const std::pair<const char*, std::function<nlohmann::json()>> checks[] = {
+		{ "framing", EasyIPCBench::verifyFraming },
+		{ "replay-window", EasyIPCBench::verifyReplayWindow }
+	};
+
+	for (const auto& [name, verify] : checks)
+	{
+		if (!only.empty() && only != name)
+			continue;
+
+		nlohmann::json verification = verify();
+
+		bool passed = verification["passed"];
+		allPassed = allPassed && passed;
+
+		std::fprintf(stderr, "%-28s verification %s (%d checks)\n", name, passed ? "passed" : "FAILED", verification["trials"].get<int>());
+
+		for (const nlohmann::json& failure : verification["failures"])
+		{
+			std::fprintf(stderr, "  %s\n", failure.get<std::string>().c_str());
+		}
+
+		report[name] = verification;
+	}
+
+	if (!verifyOnly && (only.empty() || only == "envelope"))
+	{
+		report["envelopes"] = EasyIPCBench::benchmarkEnvelopes(options);
+		printEnvelopeSummary(report["envelopes"]);
+	}
+
+	report["passed"] = allPassed;
+
+	if (jsonPath == "-")
+	{
+		std::cout << report.dump(2) << "\n";
+	}
+	else if (!jsonPath.empty())
+	{
+		std::ofstream file{ jsonPath };
+		file << report.dump(2) << "\n";
+
+		if (!file)
+		{
+			std::fprintf(stderr, "Failed to write %s\n", jsonPath.c_str());
+			return 2;
+		}
+	}
+
+	return allPassed ? 0 : 1;
+}
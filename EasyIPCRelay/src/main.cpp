@@ -0,0 +1,64 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "Relay.h"
+
+namespace
+{
+	std::atomic<bool> stopRequested{ false };
+
+	void onSignal(int)
+	{
+		stopRequested = true;
+	}
+
+	uint16_t parsePort(const char* value)
+	{
+		int port = std::stoi(value);
+		if (port <= 0 || port > 65535)
+		{
+			throw std::invalid_argument{ std::string("Invalid port ") + value };
+		}
+
+		return static_cast<uint16_t>(port);
+	}
+}
+
+// Usage: EasyIPCRelay <server url> <server port> <listen url> <listen port>
+// e.g.   EasyIPCRelay tcp://10.0.0.5 57239 tcp://0.0.0.0 57239
+int main(int argc, char* argv[])
+{
+	if (argc != 5)
+	{
+		std::cerr << "Usage: " << argv[0] << " <server url> <server port> <listen url> <listen port>\n"
+			<< "Example: " << argv[0] << " tcp://10.0.0.5 57239 tcp://0.0.0.0 57239\n";
+		return 1;
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	try
+	{
+		EasyIPC::Relay relay;
+		relay.start(argv[1], parsePort(argv[2]), argv[3], parsePort(argv[4]));
+
+		while (!stopRequested)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+
+		relay.shutdown();
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << "[EasyIPCRelay] " << exception.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}